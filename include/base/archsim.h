@@ -40,6 +40,9 @@
 #include "instr_pipeline.h"
 #include "instr.h"
 #include "elf_loader.h"
+#include "snapshot.h"
+#include "hierarchy.h"
+#include "prefetch.h"
 
 /* Function declarations
  * The following function declarations allow any file that #includes archsim.h
@@ -73,6 +76,9 @@ extern FILE *checkpoint;
 
 /* Used to pass in the name of the input ELF file, through handle_args */
 extern char *infile_name;
+/* Snapshot files: written when the run stops (-S), resumed from instead of running the ELF file (-R) */
+extern char *snapshot_save_name;
+extern char *snapshot_restore_name;
 
 /* Count the number of instructions executed by the simulator */
 extern uint64_t num_instr;
@@ -81,6 +87,14 @@ extern uint64_t cycle_max;
 
 /* Used to enable verbose debug logging, as a parameter to show_instr */
 extern int debug_level;
+/* Used to print emulator statistics (TLB, page allocation, ...) at exit */
+extern bool print_stats;
+/* Used to write only the pages changed since the previous checkpoint (see ckpt-merge) */
+extern bool incremental_checkpoints;
+/* Used to also write a checkpoint every so many cycles; 0 for only the final one */
+extern uint64_t checkpoint_interval;
+/* Used to write dirty cache lines back to memory before each checkpoint, for comparing with runs without a cache */
+extern bool flush_checkpoints;
 /* This is a string containing the prompt that will be displayed by ae. */
 extern char *ae_prompt;
 
@@ -89,6 +103,22 @@ extern int A;
 extern int B;
 extern int C;
 extern int d;
+/* Levels below the first (-L), and how blocks are shared between levels (-F) */
+extern cache_spec_t cache_levels[MAX_CACHE_LEVELS];
+extern int num_cache_levels;
+extern fill_policy_t fill_policy;
+/* L1 instruction cache (-I); A is -1 if there is none */
+extern cache_spec_t icache_spec;
+/* Outstanding data cache misses (-M); 0 for a blocking cache */
+extern int num_mshrs;
+/* Data cache prefetcher (-p) */
+extern prefetcher_kind_t prefetch_kind;
+/* L1 data cache write policy (-W, -N) and write buffer entries (-b) */
+extern bool write_through;
+extern bool no_write_allocate;
+extern int wbuf_depth;
+/* Lines in the L1 data cache's victim cache (-V); 0 for none */
+extern int victim_lines;
 
 /* These are booleans used to control program execution.
  * If ignore_input is true, the current input will no longer be processed. 
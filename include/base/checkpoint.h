@@ -0,0 +1,28 @@
+/**************************************************************************
+ * C S 429 system emulator
+ * 
+ * checkpoint.h - Headers for writing the memory part of checkpoints.
+ * 
+ * Shared by the emulator and by ckpt-merge, which rebuilds full
+ * checkpoints from incremental ones and must print them identically.
+ * 
+ * Copyright (c) 2023.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/ 
+
+#ifndef _CHECKPOINT_H_
+#define _CHECKPOINT_H_
+#include <stdio.h>
+#include <stdint.h>
+
+// Header line of the memory part of an incremental checkpoint.
+#define CKPT_DELTA_HEADER "\tMemory pages changed since the last checkpoint:\n"
+
+// Host address of a guest page if it exists, NULL otherwise.
+typedef char *(*page_peek_t)(const uint64_t);
+
+// Print the "Memory state" part of a full checkpoint: the nonzero words of
+// the text, data, heap and stack pages, given the segment start addresses.
+extern void log_mem_state(FILE *, const uint64_t *, page_peek_t);
+#endif
@@ -15,4 +15,8 @@
 #include <stdint.h>
 
 extern uint64_t loadElf(const char *file);
+
+// Pages shared with the mmapped file, and pages that had to be copied.
+extern uint64_t elf_pages_shared;
+extern uint64_t elf_pages_copied;
 #endif
\ No newline at end of file
@@ -0,0 +1,51 @@
+/**************************************************************************
+ * C S 429 system emulator
+ * 
+ * flatmem.h - Headers for the flat, host-mmap-backed guest memory backend.
+ * 
+ * Each guest segment is backed by one large MAP_NORESERVE host region, so
+ * translating a guest address is a bounds check and an add. The host
+ * kernel provides demand paging and zero fill. Addresses outside every
+ * region fall back to the page table.
+ * 
+ * Copyright (c) 2023.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/ 
+
+#ifndef _FLATMEM_H_
+#define _FLATMEM_H_
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Largest host reservation made for a single guest segment.
+#define FLAT_MAX_REGION (16ULL << 30)
+
+// A host region standing in for one guest segment.
+typedef struct flat_region {
+    uint64_t start;     // First guest address covered
+    uint64_t size;      // Number of bytes covered
+    char *base;         // Host address of guest address start
+} flat_region_t;
+
+extern flat_region_t flat_regions[];
+extern unsigned flat_num_regions;
+
+// Return the host address of a guest address, or NULL if no region covers it.
+static inline char *flat_translate(const uint64_t addr) {
+    for (unsigned i = 0; i < flat_num_regions; i++) {
+        flat_region_t *r = &flat_regions[i];
+        if (addr - r->start < r->size)
+            return r->base + (addr - r->start);
+    }
+    return NULL;
+}
+
+// Reserve one host region per segment in [TEXT_SEG, KERNEL_SEG).
+extern void init_flat_mem(const uint64_t *seg_starts);
+// Whether the host has materialized the page at this guest address.
+extern bool flat_page_touched(const uint64_t addr);
+// Release all regions.
+extern void free_flat_mem(void);
+#endif
@@ -0,0 +1,119 @@
+/**************************************************************************
+ * C S 429 system emulator
+ *
+ * hierarchy.h - Headers for the levels of cache below the L1 data cache.
+ *
+ * guest.cache is the first level. Each level added with -L sits below the
+ * previous one and has its own geometry and hit latency; memory sits below
+ * the last level, with the latency given by -d. All levels share one
+ * block size, so a block moves between levels whole. An L1 instruction
+ * cache given with -I sits beside the first level, over the same levels.
+ *
+ * The first level is write-back and write-allocate unless -W through or -N
+ * say otherwise. A store it does not keep to itself goes to the level
+ * below at once, so the data is always right, and through a coalescing
+ * write buffer that models the time and traffic it costs.
+ *
+ * Copyright (c) 2023.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/
+
+#ifndef _HIERARCHY_H_
+#define _HIERARCHY_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include "cache/cache.h"
+
+#define MAX_CACHE_LEVELS 4
+#define WBUF_ENTRIES 16         // Most entries a write buffer can have
+#define WBUF_MAX_B 256          // Largest block a write buffer entry can hold
+
+// Which levels hold a block, relative to the levels above them.
+typedef enum {
+    FILL_NINE,       // Filled into every level on the way in; no back-invalidation
+    FILL_INCLUSIVE,  // As NINE, and a block leaving a level leaves the levels above
+    FILL_EXCLUSIVE   // A block lives in one level; lower levels take victims from above
+} fill_policy_t;
+
+// Geometry of a level, as given on the command line.
+typedef struct cache_spec {
+    int A, B, C;
+    unsigned latency;
+} cache_spec_t;
+
+typedef struct cache_level {
+    char name[4];               // "L1D", "L2", ...
+    cache_t *cache;
+    unsigned latency;           // Cycles to bring in a block that hits here
+    uint64_t hits, misses;      // Lookups that reached this level
+    uint64_t writebacks;        // Dirty blocks written to the level below
+    uint64_t read_bytes;        // Traffic from the level below
+    uint64_t write_bytes;       // Traffic to the level below
+    byte_t *victim_data;        // Scratch space for a block evicted from here
+} cache_level_t;
+
+typedef struct wbuf_entry {
+    uint64_t block;                     // Address of the block
+    uint64_t mask[WBUF_MAX_B / 64];     // Bytes of it written
+} wbuf_entry_t;
+
+// FIFO of blocks on their way below the first level, one entry per block.
+typedef struct write_buffer {
+    int depth;                  // Entries in use
+    int head, count;
+    wbuf_entry_t entries[WBUF_ENTRIES];
+    uint64_t next_drain;        // Cycle the head entry has been written by
+    uint64_t stores;            // Stores that went through the buffer
+    uint64_t coalesced;         // Of those, stores to a block already in it
+    uint64_t full_stalls;       // Cycles a store waited for a free entry
+} write_buffer_t;
+
+typedef struct hierarchy {
+    cache_level_t levels[MAX_CACHE_LEVELS];  // levels[0] is guest.cache
+    cache_level_t icache;       // guest.icache; icache.cache is NULL without one
+    int num_levels;
+    fill_policy_t fill;
+    unsigned mem_latency;
+    byte_t *fill_data;          // Block on its way into the first level
+    bool write_through;         // First level: stores also go below
+    bool write_allocate;        // First level: a store miss brings the block in
+    write_buffer_t wbuf;
+    byte_t *store_data;         // Block of memory a store is patching
+} hierarchy_t;
+
+extern hierarchy_t hierarchy;
+
+// Set up the hierarchy below an existing first-level cache. Returns false,
+// after logging why, if a level cannot be built.
+extern bool init_hierarchy(cache_t *, unsigned mem_latency, const cache_spec_t *, int, fill_policy_t);
+// Add an L1 instruction cache over the levels below the first. Returns
+// false, after logging why, if it cannot be built.
+extern bool init_icache(const cache_spec_t *);
+// Set the first level's write policy. Returns false, after logging why,
+// if the write buffer cannot be built.
+extern bool init_write_policy(bool write_through, bool write_allocate, int depth);
+// Cycles a first-level miss on a block will take. Changes no state.
+extern unsigned hierarchy_miss_latency(uint64_t block);
+// Bring a block that missed in the first level into it, moving blocks
+// between the levels below as the fill policy requires.
+extern void hierarchy_fill(uint64_t block, operation_t op);
+// The same for a block that missed in the instruction cache.
+extern void hierarchy_fill_icache(uint64_t block);
+// Whether the write buffer can take a store to this block this cycle.
+extern bool write_buffer_room(uint64_t block);
+// Send a store down from the first level: the data goes to the nearest
+// level below that has the block, or to memory, and into the write buffer.
+// The caller has checked write_buffer_room().
+extern void hierarchy_store(uint64_t addr, uint64_t data);
+// Drain the head of the write buffer if it is due.
+extern void write_buffer_tick(uint64_t now);
+// Drain the whole write buffer, for a machine that has halted.
+extern void write_buffer_drain(void);
+// Copy every dirty block in the data caches to memory, leaving the caches
+// as they are, so a checkpoint shows the newest data. For -f.
+extern void hierarchy_write_back(void);
+// Per-level hit, miss and writeback counts, for -s.
+extern void log_hierarchy_stats(FILE *);
+#endif
@@ -34,10 +34,12 @@ typedef struct machine {
     proc_t *proc;               // Pointer to machine's processor
     mem_t *mem;                 // Pointer to machine's memory
     cache_t *cache;             // Pointer to machine's cache
+    cache_t *icache;            // Pointer to machine's instruction cache, or NULL
 } machine_t;
 
 extern uint64_t seg_starts[];   // Starting locations of memory segments (e.g., code, data, stack, etc.).
 
 extern void init_machine(char *, unsigned, byte_order_t, byte_order_t);
 extern void log_machine_state(void);
+extern void log_machine_stats(FILE *);
 #endif
\ No newline at end of file
@@ -49,6 +49,22 @@ typedef struct mem {
     uint8_t seg_prot[KERNEL_SEG+1];         // Protection bits for each memory segment
 } mem_t;
 
+// Protection bits, as in seg_prot and in each page table entry.
+#define MEM_PROT_R 0x4
+#define MEM_PROT_W 0x2
+#define MEM_PROT_X 0x1
+
+// How far below seg_start_addr[STACK_SEG] the stack may grow.
+#define STACK_LIMIT (8ULL << 20)
+
+// Host-side representation of guest memory.
+typedef enum {
+    MEM_PTABLE,     // Pages materialized on first touch in a radix page table
+    MEM_FLAT        // One sparse host mapping per segment (see flatmem.h)
+} mem_backend_t;
+
+extern mem_backend_t mem_backend;
+
 // Status of a memory request. Needed for week 4, when cache delay is modeled.
 typedef enum {
     READY,      // Memory access has completed
@@ -76,6 +92,27 @@ extern write_ret_code_t mem_write_I (uint64_t address, int       data);
 extern write_ret_code_t mem_write_L (uint64_t address, long      data);
 extern write_ret_code_t mem_write_LL(uint64_t address, long long data);
 
+// Host address of a guest page, materialized with the given protection
+// bits if needed. Used by the ELF loader; performs no access checks.
+extern char *mem_host_page(const uint64_t pnum, const uint8_t prot);
+// Make a guest page exist without allocating memory for it. Reads see zeros.
+extern void mem_reserve_page(const uint64_t pnum, const uint8_t prot);
+// Host address of a guest page if it has been touched, NULL otherwise.
+extern char *mem_peek_page(const uint64_t pnum);
+
+// Copy a cache block between guest memory and the host. No access checks,
+// and the block must not cross a page.
+extern void mem_read_block(const uint64_t addr, uint8_t *buf, const unsigned len);
+extern void mem_write_block(const uint64_t addr, const uint8_t *buf, const unsigned len);
+// Whether the L1 instruction cache has the block holding addr, starting
+// or continuing a miss on it if not.
+extern bool mem_fetch_ready(const uint64_t addr);
+
+// Rebuild the segment map after guest.mem->seg_start_addr changes.
+extern void mem_update_segments(void);
+// Whether every page touched by an access of width bytes allows all of prot.
+extern bool mem_access_ok(const uint64_t addr, const unsigned width, const uint8_t prot);
+
 // Helper functions.
 extern bool addr_in_imem(const uint64_t);
 extern bool addr_in_dmem(const uint64_t);
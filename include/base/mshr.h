@@ -0,0 +1,69 @@
+/**************************************************************************
+ * C S 429 system emulator
+ *
+ * mshr.h - Headers for the miss status holding registers of the L1 data
+ * cache.
+ *
+ * With -M n the data cache keeps up to n misses outstanding, one block per
+ * entry. Each entry knows the cycle its block arrives on; a later miss to
+ * the same block merges into it, and a store that misses leaves its data
+ * there to be written once the block is in. Without -M there are no
+ * entries and the cache blocks on every miss, as before.
+ *
+ * Copyright (c) 2023.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/
+
+#ifndef _MSHR_H_
+#define _MSHR_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MAX_MSHRS 16
+#define MSHR_STORES 8   // Stores one entry can hold
+
+typedef struct mshr_store {
+    uint64_t addr;
+    uint64_t data;
+} mshr_store_t;
+
+typedef struct mshr {
+    bool valid;
+    uint64_t block;
+    uint64_t ready;                     // Cycle the block arrives on
+    int num_stores;
+    mshr_store_t stores[MSHR_STORES];   // In program order
+} mshr_t;
+
+typedef struct mshr_file {
+    int num;                            // Entries in use; 0 for a blocking cache
+    mshr_t entries[MAX_MSHRS];
+    uint64_t mlp_hist[MAX_MSHRS + 1];   // Cycles with i misses outstanding
+    uint64_t merged;                    // Misses to a block already outstanding
+    uint64_t full_stalls;               // Cycles a miss waited for a free entry
+} mshr_file_t;
+
+extern mshr_file_t mshrs;
+
+extern void init_mshrs(int);
+// The entry for a block, or NULL if it is not outstanding.
+extern mshr_t *mshr_find(uint64_t block);
+// Start a miss on a block. Returns NULL if every entry is busy.
+extern mshr_t *mshr_alloc(uint64_t block, uint64_t ready);
+// Leave a store in an entry. Returns false if the entry is full.
+extern bool mshr_add_store(mshr_t *, uint64_t addr, uint64_t data);
+// Bring an entry's block into the cache and write its stores.
+extern void mshr_complete(mshr_t *);
+// Complete the entries due by this cycle and count the rest in the histogram.
+extern void mshr_tick(uint64_t now);
+// Complete every entry, for a machine that has halted.
+extern void mshr_drain(void);
+// Copy the stores waiting in the entries to memory, in order, leaving the
+// entries as they are. For -f, after hierarchy_write_back().
+extern void mshr_write_back(void);
+// MLP histogram and merge counts, for -s.
+extern void log_mshr_stats(FILE *);
+#endif
@@ -0,0 +1,87 @@
+/**************************************************************************
+ * C S 429 system emulator
+ *
+ * prefetch.h - Headers for the hardware prefetchers of the L1 data cache.
+ *
+ * The memory stage reports each demand miss, and each first hit on a
+ * prefetched line, to the prefetcher chosen with -p. The prefetcher picks
+ * blocks to fetch; each one is in flight for the latency of the level that
+ * holds it, like a demand miss, and then goes into the L1 data cache with
+ * its line marked as prefetched. Nothing waits on a prefetch unless a
+ * demand access wants its block before it arrives.
+ *
+ * Copyright (c) 2023.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/
+
+#ifndef _PREFETCH_H_
+#define _PREFETCH_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PREFETCH_QUEUE 16   // Prefetches in flight at once
+#define STRIDE_DEGREE 2     // Blocks ahead the stride prefetcher runs
+#define NUM_STREAMS 4
+#define STREAM_DEPTH 4      // Blocks ahead each stream runs
+
+typedef enum {
+    PF_NONE,
+    PF_NEXT_LINE,   // The block after every trigger
+    PF_STRIDE,      // Constant distance between successive triggers, PC-less
+    PF_STREAM       // Runs ahead of up to NUM_STREAMS sequential streams
+} prefetcher_kind_t;
+
+typedef struct prefetch_req {
+    bool valid;
+    uint64_t block;                 // Address of the block
+    uint64_t ready;                 // Cycle the block arrives on
+} prefetch_req_t;
+
+typedef struct stream {
+    bool valid;
+    int64_t dir;                    // +1 or -1
+    uint64_t next;                  // Next block to prefetch
+    uint64_t last_use;              // For replacing the least recently used stream
+} stream_t;
+
+typedef struct prefetcher {
+    prefetcher_kind_t kind;
+    prefetch_req_t queue[PREFETCH_QUEUE];
+    // Last trigger, as a block number (address / B), and the distance to it
+    uint64_t last_block;
+    int64_t last_stride;
+    // Streams
+    stream_t streams[NUM_STREAMS];
+    uint64_t clock;
+    // Counters
+    uint64_t issued;                // Prefetches sent to the hierarchy
+    uint64_t dropped;               // Prefetches not sent: queue full
+    uint64_t useful;                // Prefetched blocks a demand access used
+    uint64_t late;                  // Of those, blocks still in flight when wanted
+    uint64_t unused;                // Prefetched lines that left the cache unused
+} prefetcher_t;
+
+extern prefetcher_t prefetcher;
+
+// Returns the prefetcher named, or -1 for an unknown name.
+extern int parse_prefetcher(const char *);
+extern const char *prefetcher_name(prefetcher_kind_t);
+extern void init_prefetcher(prefetcher_kind_t, unsigned num_lines);
+// A demand access to the L1 data cache, the first try only.
+extern void prefetch_access(uint64_t addr, bool hit);
+// A demand miss wants a block. If a prefetch has it in flight, the demand
+// takes it over: the prefetch is cancelled and *ready gets its arrival.
+extern bool prefetch_claim(uint64_t block_addr, uint64_t *ready);
+// A block has gone into the given L1 data cache line.
+extern void prefetch_filled(long line);
+// Whether a line holds a prefetched block no demand access has used yet.
+extern bool prefetch_line_unused(long line);
+extern void prefetch_set_line_unused(long line, bool);
+// Bring in the prefetches due by this cycle.
+extern void prefetch_tick(uint64_t now);
+// Accuracy, coverage and timeliness, for -s.
+extern void log_prefetch_stats(FILE *);
+#endif
@@ -36,4 +36,9 @@ typedef struct proc {
 
 // Run the loaded ELF executable for no more than a specified number of cycles.
 extern int runElf(const uint64_t);
+// Allocate the pipeline registers, all holding bubbles.
+extern void init_pipeline(void);
+// Clock the pipeline from its current state until the program halts or
+// num_instr reaches cycle_max. Used directly to resume from a snapshot.
+extern int run_pipeline(void);
 #endif
\ No newline at end of file
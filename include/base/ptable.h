@@ -14,6 +14,7 @@
 #ifndef _PTABLE_H_
 #define _PTABLE_H_
 #include <stdint.h>
+#include <stdbool.h>
 
 /* This corresponds to the Arm64 notion of a hardware page (see ADRP) */
 #define PAGESIZE 4096
@@ -22,12 +23,56 @@
 typedef struct pte {
     uint64_t p_num;     // The page number.
     unsigned p_prot;    // The page protection bits.
+    bool p_cow;         // Whether p_data is shared and must be copied before the first write.
+    bool p_dirty;       // Whether the page was created or written since the last checkpoint.
     char *p_data;       // The page payload.
-    struct pte *p_next; // Link to next PTE.
+    struct pte *p_next; // Link to next PTE (only used above 2^48).
 } pte_t, *pte_ptr_t;
 
 // Get a pointer to a PTE given its page number.
 extern pte_ptr_t get_page(const uint64_t);
 // Materialize a page with the given page number and protection bits.
 extern pte_ptr_t add_page(const uint64_t, const uint8_t);
+// Materialize a page whose payload is shared with someone else (e.g., the
+// mmapped ELF file) and copied on first write. The payload must outlive the page.
+extern pte_ptr_t add_cow_page(const uint64_t, const uint8_t, const char *);
+// Materialize a page backed by the shared zero page, copied on first write.
+extern pte_ptr_t add_zero_page(const uint64_t, const uint8_t);
+// Give a copy-on-write page a private copy of its payload.
+extern void unshare_page(pte_ptr_t);
+
+// Whether a page is still backed by the shared zero page.
+extern bool page_is_zero(const pte_ptr_t);
+// Call visit on every PTE, in ascending page number order below 2^48.
+extern void walk_ptable(void (*visit)(pte_ptr_t, void *), void *arg);
+
+// Record a write to a page. New pages start out dirty.
+extern void mark_dirty(pte_ptr_t);
+// The dirty pages, and their number in *n. The array stays valid until the
+// next page is marked dirty.
+extern pte_ptr_t *dirty_pages(uint64_t *n);
+// Clear every dirty bit, e.g., once a checkpoint has recorded the pages.
+extern void clean_pages(void);
+
+// Number of pages currently backed by the shared zero page, i.e., page
+// allocations avoided so far.
+extern uint64_t zero_pages;
+// Number of copy-on-write pages that have been given private payloads.
+extern uint64_t cow_copies;
+
+// Page payloads are carved out of host chunks of this size.
+#define ARENA_CHUNK_SIZE (2UL << 20)
+
+// Statistics for the allocator behind the page table.
+typedef struct arena_stats {
+    uint64_t chunks;        // 2 MiB host chunks mapped
+    uint64_t frames;        // Page payloads handed out
+    uint64_t nodes;         // Radix tree nodes handed out
+    uint64_t ptes;          // PTEs handed out
+    uint64_t pte_blocks;    // PTE pool blocks allocated
+} arena_stats_t;
+extern arena_stats_t arena_stats;
+
+// Release every page, PTE and table node at once.
+extern void free_ptable(void);
 #endif
\ No newline at end of file
@@ -0,0 +1,24 @@
+/**************************************************************************
+ * C S 429 system emulator
+ * 
+ * snapshot.h - Headers for saving and restoring whole-emulator snapshots.
+ * 
+ * A snapshot holds everything needed to resume a run where it stopped:
+ * registers, pipeline registers, pages, cache contents and the state of
+ * an in-flight cache miss. The format is a raw dump of host structures,
+ * so snapshots are only good for the se binary that wrote them.
+ * 
+ * Copyright (c) 2023.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/ 
+
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+// Write the current emulator state to a file.
+extern void save_snapshot(const char *);
+// Replace the freshly initialized emulator state with the one in a file,
+// ready for run_pipeline(). Pages are mapped from the file, not read.
+extern void restore_snapshot(const char *);
+#endif
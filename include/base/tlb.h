@@ -0,0 +1,64 @@
+/**************************************************************************
+ * C S 429 system emulator
+ * 
+ * tlb.h - Headers for the software TLB used by the emulator.
+ * 
+ * The TLB is a small direct-mapped cache of guest page number -> host
+ * pointer translations sitting in front of the page table, so the common
+ * case of a memory access needs one compare instead of a page table walk.
+ * 
+ * Copyright (c) 2023.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/ 
+
+#ifndef _TLB_H_
+#define _TLB_H_
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "ptable.h"
+
+#define TLB_BITS 8
+#define TLB_ENTRIES (1 << TLB_BITS)
+// No page number is this large, since pages are 4 KiB.
+#define TLB_INVALID (~0ULL)
+
+// A TLB entry.
+typedef struct tlb_entry {
+    uint64_t t_num;     // The guest page number, or TLB_INVALID.
+    char *t_data;       // The host address of the page payload.
+    unsigned t_prot;    // The page protection bits.
+    bool t_writable;    // Whether writes may use the entry: the page is private and already dirty.
+} tlb_entry_t;
+
+extern tlb_entry_t tlb[TLB_ENTRIES];
+extern uint64_t tlb_hits;
+extern uint64_t tlb_misses;
+
+// Return the TLB entry for a page number, or NULL on a TLB miss.
+// A write is a miss unless the entry is writable, so that the page table
+// can copy a copy-on-write page and mark the page dirty first.
+static inline tlb_entry_t *tlb_lookup(const uint64_t pnum, const bool write) {
+    tlb_entry_t *e = &tlb[pnum & (TLB_ENTRIES - 1)];
+    if (e->t_num == pnum && !(write && !e->t_writable)) {
+        tlb_hits++;
+        return e;
+    }
+    tlb_misses++;
+    return NULL;
+}
+
+// Return the TLB entry for a page number without counting a hit or miss.
+static inline tlb_entry_t *tlb_peek(const uint64_t pnum) {
+    tlb_entry_t *e = &tlb[pnum & (TLB_ENTRIES - 1)];
+    return e->t_num == pnum ? e : NULL;
+}
+
+// Install the translation for a PTE, replacing whatever shared its slot.
+extern tlb_entry_t *tlb_fill(const pte_ptr_t);
+// Drop the translation for a single page number, if present.
+extern void tlb_invalidate(const uint64_t);
+// Drop all translations.
+extern void tlb_flush(void);
+#endif
@@ -15,33 +15,79 @@
 #include <stdbool.h>
 
 /*
- * A possible hierarchy for the cache. The helper functions defined below
- * are based on this cache structure.
- * lru is a counter used to implement LRU replacement policy.
+ * The cache is laid out as a structure of arrays. Line i of set s is
+ * entry s*A + i of each per-line array, so the tags (and valid bits,
+ * dirty bits and LRU counters) of a set sit next to each other and can be
+ * compared several at a time. Line data lives in one slab, B bytes per line.
+ * lru is a counter used to implement LRU replacement policy. Under FIFO
+ * it is only set when a line is filled, so it orders lines by arrival.
+ * The address split (offset, index and tag) is worked out once by
+ * create_cache() and kept alongside A, B and C.
+ *
+ * Replacement follows cache->policy. Every policy but LRU and FIFO keeps its state
+ * in REPL_WORDS words per set (repl), one bit or a few bits per way, so
+ * those policies need A <= 64 (and tree-PLRU a power of two).
  */
 
 typedef unsigned char byte_t;
 typedef long long int word_t;
 typedef long long unsigned uword_t;
 
-typedef struct cache_line {
-    bool valid;
-    uword_t tag;
-    bool dirty;
-    uword_t lru;
-    byte_t *data;
-} cache_line_t;
+typedef enum {
+    REPL_LRU,       /* True LRU, by timestamp */
+    REPL_PLRU,      /* Tree pseudo-LRU */
+    REPL_BIT_PLRU,  /* MRU-bit pseudo-LRU */
+    REPL_SRRIP,     /* Static re-reference interval prediction */
+    REPL_BRRIP,     /* Bimodal RRIP */
+    REPL_FIFO,
+    REPL_RANDOM
+} repl_policy_t;
+
+#define REPL_WORDS 4
+
+/*
+ * A victim cache is a small fully associative LRU cache beside a cache.
+ * handle_miss() puts the line it evicts there, and only the line that
+ * pushes out of the victim cache leaves for good (and is counted as an
+ * eviction). After a miss, victim_hit() looks for the block there and, if
+ * it is there, swaps it with the line it displaces in the cache.
+ */
+#define VICTIM_MAX 64
 
-typedef struct cache_set {
-    cache_line_t *lines;
-} cache_set_t;
+typedef struct victim_cache {
+    unsigned int lines;
+    uword_t *addrs;     /* Block address of each line */
+    bool *valid;
+    bool *dirty;
+    uword_t *lru;       /* Own clock, apart from next_lru */
+    byte_t *data;       /* B bytes per line */
+    byte_t *swap;       /* B bytes of scratch space for a swap */
+    byte_t *spill;      /* B bytes for a line on its way in, when the
+                           caller of handle_miss() wants no copy */
+    uword_t clock;
+    unsigned long hits, misses;
+} victim_cache_t;
 
 typedef struct cache {
-    cache_set_t *sets;
+    uword_t *tags;  /* Tag of each line */
+    bool *valid;    /* Valid bit of each line */
+    bool *dirty;    /* Dirty bit of each line */
+    uword_t *lru;   /* LRU counter of each line, fill order under FIFO */
+    byte_t *data;   /* Line data, B bytes per line */
     unsigned int A; /* Associativity */
     unsigned int B; /* Bytes per block or line */
     unsigned int C; /* Capacity */
     unsigned int d; /* delay - used as a cache miss penalty */
+    unsigned int S; /* Number of sets */
+    unsigned int b_bits;   /* Block offset bits, log2(B) */
+    unsigned int s_bits;   /* Set index bits, log2(S) */
+    unsigned int tag_shift; /* b_bits + s_bits */
+    uword_t off_mask;      /* B - 1 */
+    uword_t set_mask;      /* S - 1 */
+    repl_policy_t policy;  /* Replacement policy */
+    uword_t *repl;         /* Replacement state, REPL_WORDS per set */
+    uword_t rng;           /* State of the random number generator */
+    victim_cache_t *victim; /* NULL without a victim cache */
 } cache_t;
 
 
@@ -57,17 +103,52 @@ typedef struct {
     byte_t *data;
 } evicted_line_t;
 
+/* Counts kept by access_batch(), in the caller's hands, not the globals */
+typedef struct cache_stats {
+    unsigned long hits, misses, dirty_evictions, clean_evictions;
+} cache_stats_t;
+
+
+/* Policy used by create_cache(); LRU unless a flag says otherwise. */
+extern repl_policy_t repl_policy;
+int parse_repl_policy(const char *name);
+const char *repl_policy_name(repl_policy_t policy);
+bool repl_policy_supported(repl_policy_t policy, unsigned int A);
 
 cache_t *create_cache(int A_in, int B_in, int C_in, int d_in);
 void free_cache(cache_t *cache);
 void access_data(cache_t *cache, uword_t addr, operation_t operation);
+/* access_data() on each of addrs[i] with ops[i], adding the outcomes to
+   *out. Allocates nothing, and prefetches the sets of accesses ahead. */
+void access_batch(cache_t *cache, const uword_t *addrs, const operation_t *ops, size_t n,
+                  cache_stats_t *out);
 
-evicted_line_t *handle_miss(cache_t *cache, uword_t addr, operation_t operation, byte_t *incoming_data);
+/* Fills *evicted, whose data is B bytes of the caller's or NULL. */
+void handle_miss(cache_t *cache, uword_t addr, operation_t operation, byte_t *incoming_data,
+                 evicted_line_t *evicted);
 bool check_hit(cache_t *cache, uword_t addr, operation_t operation);
 
 void get_word_cache(cache_t *cache, uword_t addr, word_t *dest);
 void set_word_cache(cache_t *cache, uword_t addr, word_t val);
 
+/*
+ * Building blocks for a hierarchy of caches. Unlike check_hit() and
+ * handle_miss(), these leave the hit, miss and eviction counters alone.
+ */
+long cache_find(cache_t *cache, uword_t addr);
+void cache_touch(cache_t *cache, uword_t addr, long line);
+long cache_insert(cache_t *cache, uword_t addr, const byte_t *data, bool dirty, evicted_line_t *victim);
+void cache_invalidate(cache_t *cache, long line);
+uword_t cache_line_addr(cache_t *cache, long line);
+
+/* Give a cache a victim cache of 1 to VICTIM_MAX lines. */
+void cache_add_victim(cache_t *cache, unsigned int lines);
+/* Line of the victim cache that holds addr, or -1. Changes no state. */
+long victim_find(cache_t *cache, uword_t addr);
+/* After a miss on addr: if the victim cache has the block, swap it into
+   the cache and return true. Counts a victim hit or miss. */
+bool victim_hit(cache_t *cache, uword_t addr, operation_t operation);
+
 cache_t *create_checkpoint(cache_t *cache);
 void display_set(cache_t *cache, unsigned int set_index);
 #endif
\ No newline at end of file
@@ -0,0 +1,49 @@
+/**************************************************************************
+ * C S 429 system emulator
+ *
+ * stackdist.h - Headers for LRU stack distance (Mattson) analysis.
+ *
+ * The stack distance of an access is the number of other blocks used
+ * since the last access to its block. A fully associative LRU cache of k
+ * lines hits exactly the accesses with distance below k, so one pass that
+ * records the distance histogram gives the miss ratio of every capacity.
+ *
+ * Copyright (c) 2023.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/
+
+#ifndef _STACKDIST_H_
+#define _STACKDIST_H_
+#include <stdio.h>
+#include <stdint.h>
+#include "cache.h"
+
+typedef struct stackdist {
+    unsigned int b_bits;    /* log2 of the block size */
+    uint64_t now;           /* Time of the next access, in the tree's numbering */
+    uint64_t accesses;
+    /* Last access time of each block seen, by open addressing on the block */
+    uword_t *keys;
+    uint64_t *last;
+    bool *used;
+    uint64_t num_blocks, table_size;
+    /* Fenwick tree over access times: 1 where a block was last used */
+    unsigned int *tree;
+    uint64_t tree_size;
+    /* hist[d] accesses had distance d; num_blocks more were cold */
+    uint64_t *hist;
+    uint64_t hist_size;
+} stackdist_t;
+
+stackdist_t *stackdist_create(unsigned int B);
+void stackdist_free(stackdist_t *sd);
+/* Record an access to addr. O(log M) for M blocks seen. */
+void stackdist_access(stackdist_t *sd, uword_t addr);
+/* Print the miss-ratio curve as CSV rows: one for 1 line, then one for
+   each capacity where the miss count drops, down to the cold misses. */
+void stackdist_print(stackdist_t *sd, FILE *out);
+/* Analyse a trace for each of the n block sizes in one pass, and print a
+   CSV table of their curves. */
+void run_stackdist(const char *trace_fn, const int *Bs, int n, FILE *out);
+#endif
@@ -0,0 +1,37 @@
+/**************************************************************************
+ * C S 429 system emulator
+ *
+ * sweep.h - Headers for simulating many cache geometries at once.
+ *
+ * A sweep simulates every A x B x C combination over a single pass of a
+ * trace. The trace is parsed once, a chunk at a time, and each chunk is
+ * replayed through every configuration by a pool of worker threads while
+ * the next chunk is parsed. Each configuration keeps its own counters, so
+ * the results match separate csim runs.
+ *
+ * Copyright (c) 2023.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/
+
+#ifndef _SWEEP_H_
+#define _SWEEP_H_
+#include <stdio.h>
+#include "cache.h"
+
+#define SWEEP_MAX_VALUES 32     /* Values each of A, B and C can take */
+#define SWEEP_CHUNK 65536       /* Records parsed per chunk */
+
+typedef struct sweep_config {
+    int A, B, C;
+    cache_t *cache;
+    cache_stats_t stats;
+} sweep_config_t;
+
+/* Whether A, B and C make a cache create_cache() can build. */
+bool sweep_valid(int A, int B, int C);
+/* Simulate every valid combination of the given values on up to threads
+   worker threads, and print one CSV row per configuration to out. */
+void run_sweep(const char *trace_fn, const int *As, int nA, const int *Bs, int nB,
+               const int *Cs, int nC, int threads, FILE *out);
+#endif
@@ -0,0 +1,134 @@
+/**************************************************************************
+ * C S 429 system emulator
+ *
+ * trace.h - Headers for reading Valgrind memory traces.
+ *
+ * A trace is read in batches of records, so that one parse can feed any
+ * number of caches. Only data accesses (L, S and M lines) become records;
+ * instruction fetches and anything else are skipped.
+ *
+ * A regular file is mapped into memory and scanned in place, with no
+ * allocation per line; anything else is read a line at a time. A trace
+ * queue runs the reader on a thread of its own and hands full batches to
+ * one consumer through a lock-free single-producer, single-consumer ring,
+ * so that parsing overlaps simulation.
+ *
+ * The binary format (csim -T binary, written by trace-convert) is a
+ * trace_file_hdr_t and then blocks of up to TRACE_BATCH records, each a
+ * trace_block_hdr_t and its records. A record is one byte, with the op in
+ * bits 0-1 and a size code in bits 2-4 (size 1 << code, or a LEB128 size
+ * after the byte for TRACE_LEN_VARINT), then the zigzag LEB128 difference
+ * from the previous address. Each block starts again from address 0, so
+ * blocks decode on their own. A block may be stored LZ-compressed, in
+ * which case its records are expanded into a buffer first.
+ *
+ * Copyright (c) 2023.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "cache.h"
+
+#define TRACE_BATCH 4096    /* Records a reader asks for at a time */
+#define TRACE_QUEUE 8       /* Batches a trace queue holds */
+
+#define TRACE_MAGIC "CSTRACE1"
+#define TRACE_BLOCK_LZ 1    /* Block flag: stored LZ-compressed */
+#define TRACE_LEN_VARINT 7  /* Size code: the size follows as a LEB128 */
+#define TRACE_REC_MAX 16    /* Longest encoding of one record */
+
+typedef enum {
+    TRACE_TEXT,             /* Valgrind lines */
+    TRACE_BINARY
+} trace_format_t;
+
+typedef struct trace_file_hdr {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+} trace_file_hdr_t;
+
+typedef struct trace_block_hdr {
+    uint32_t records;
+    uint32_t raw_len;       /* Bytes of encoded records */
+    uint32_t stored_len;    /* Bytes that follow; raw_len unless compressed */
+    uint32_t flags;
+} trace_block_hdr_t;
+
+typedef struct trace_rec {
+    uword_t addr;
+    unsigned int len;
+    char op;                /* 'L', 'S' or 'M' */
+} trace_rec_t;
+
+typedef struct trace {
+    trace_format_t format;
+    const char *map;        /* The mapped file, or NULL if read with fp */
+    size_t map_len;
+    const char *pos;        /* Next line, or block header, in map */
+    FILE *fp;
+    char buf[1000];
+    /* Binary: the records left in the current block */
+    const uint8_t *rec_pos, *rec_end;
+    uint32_t rec_left;
+    uword_t prev_addr;
+    uint8_t *unpacked;      /* Space for a compressed block's records */
+    size_t unpacked_len;
+} trace_t;
+
+typedef struct trace_writer {
+    FILE *fp;
+    bool compress;
+    trace_rec_t pending[TRACE_BATCH];
+    size_t num_pending;
+    uint8_t raw[TRACE_BATCH * TRACE_REC_MAX];
+    uint8_t packed[TRACE_BATCH * TRACE_REC_MAX];
+} trace_writer_t;
+
+typedef struct trace_batch {
+    size_t n;               /* 0 marks the end of the trace */
+    trace_rec_t recs[TRACE_BATCH];
+} trace_batch_t;
+
+typedef struct trace_queue {
+    trace_t *trace;
+    pthread_t reader;
+    /* Batch i lives in slots[i % TRACE_QUEUE]. The reader fills batches
+       from tail and the consumer uses them from head; each side only
+       writes its own index. */
+    _Atomic size_t head, tail;
+    bool holding;           /* The consumer still has batch head */
+    trace_batch_t slots[TRACE_QUEUE];
+} trace_queue_t;
+
+/* Format trace_open() reads; text unless csim -T says otherwise. */
+extern trace_format_t trace_format;
+/* Returns the format named ("text" or "binary"), or -1. */
+int parse_trace_format(const char *name);
+
+/* Open a trace file, or print why not and exit. */
+trace_t *trace_open(const char *name);
+/* Read up to max records into recs. Returns 0 at the end of the trace. */
+size_t trace_read(trace_t *trace, trace_rec_t *recs, size_t max);
+void trace_close(trace_t *trace);
+
+/* Write a binary trace, optionally compressing each block. Opening
+   prints why not and exits on failure. */
+trace_writer_t *trace_writer_open(const char *name, bool compress);
+void trace_write(trace_writer_t *w, const trace_rec_t *recs, size_t n);
+void trace_writer_close(trace_writer_t *w);
+
+/* Open a trace and start reading it ahead on its own thread. */
+trace_queue_t *trace_queue_start(const char *name);
+/* The next batch, or NULL at the end of the trace. The batch returned
+   before this one goes back to the reader. */
+const trace_batch_t *trace_queue_next(trace_queue_t *q);
+/* Wait for the reader and close the trace. */
+void trace_queue_stop(trace_queue_t *q);
+#endif
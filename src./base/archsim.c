@@ -17,15 +17,35 @@ machine_t       guest;
 opcode_t        itable[2<<11];
 FILE            *infile, *outfile, *errfile, *checkpoint;
 char            *infile_name;
+char            *snapshot_save_name;
+char            *snapshot_restore_name;
 char            *ae_prompt;
 uint64_t        num_instr;
 uint64_t        cycle_max;
 int             debug_level;
+bool            print_stats;
+bool            incremental_checkpoints;
+bool            flush_checkpoints;
+uint64_t        checkpoint_interval;
 int             A, B, C, d;
+cache_spec_t    cache_levels[MAX_CACHE_LEVELS];
+int             num_cache_levels;
+fill_policy_t   fill_policy;
+cache_spec_t    icache_spec;
+int             num_mshrs;
+prefetcher_kind_t prefetch_kind;
+bool            write_through;
+bool            no_write_allocate;
+int             wbuf_depth;
+int             victim_lines;
 uint64_t        inflight_cycles;
 uint64_t        inflight_addr;
 bool            inflight;
 mem_status_t    dmem_status;
+uint64_t        imem_inflight_cycles;
+uint64_t        imem_inflight_addr;
+bool            imem_inflight;
+mem_status_t    imem_status;
 
 int main(int argc, char* argv[]) {
     debug_level = 0;
@@ -33,8 +53,18 @@ int main(int argc, char* argv[]) {
     handle_args(argc, argv);
     init();
     
-    uint64_t entry = loadElf(infile_name);
-    int ret = runElf(entry);
+    int ret;
+    if (snapshot_restore_name) {
+        restore_snapshot(snapshot_restore_name);
+        // A snapshot of a program that has already halted has nothing left to run.
+        ret = EXIT_SUCCESS;
+        if (guest.proc->status == STAT_AOK || guest.proc->status == STAT_BUB)
+            ret = run_pipeline();
+    }
+    else {
+        uint64_t entry = loadElf(infile_name);
+        ret = runElf(entry);
+    }
     
     finalize();
     
@@ -0,0 +1,88 @@
+/**************************************************************************
+ * C S 429 system emulator
+ * 
+ * checkpoint.c - Module for writing the memory part of checkpoints.
+ * 
+ * Each segment is walked a page at a time from its start for as long as
+ * the pages exist; the stack is walked downwards from its top page.
+ * 
+ * Copyright (c) 2023.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/ 
+
+#include "checkpoint.h"
+#include "mem.h"
+#include "ptable.h"
+
+void log_mem_state(FILE *out, const uint64_t *seg_start, page_peek_t peek) {
+    fprintf(out, "\tMemory state:\n");
+    /* 
+     * .text section
+     * This isn't really needed since students don't 
+     * write the ELF Loader and shouldn't modify the
+     * instructions, but it was useful for debugging.
+     */
+    fprintf(out, "\t\tText segment:\n");
+    char *data;
+    uint64_t addr = seg_start[TEXT_SEG];
+    addr -= addr % PAGESIZE;
+    uint64_t pnum = addr / PAGESIZE;
+    while ((data = peek(pnum))) {
+        for (int i = 0; i < PAGESIZE; i += 8) {
+            uint64_t word = *(uint64_t *)(data + i);
+            if (word) {
+                fprintf(out, "\t\t\tAddress 0x%lx: 0x%lx\n", 
+                    addr+i, word);
+            }
+        }
+        addr += PAGESIZE;
+        pnum = addr / PAGESIZE;
+    }
+    // .data section
+    fprintf(out, "\t\tData segment:\n");
+    addr = seg_start[DATA_SEG];
+    addr -= addr % PAGESIZE;
+    pnum = addr / PAGESIZE;
+    while ((data = peek(pnum))) {
+        for (int i = 0; i < PAGESIZE; i += 8) {
+            uint64_t word = *(uint64_t *)(data + i);
+            if (word) {
+                fprintf(out, "\t\t\tAddress 0x%lx: 0x%lx\n", 
+                    addr+i, word);
+            }
+        }
+        addr += PAGESIZE;
+        pnum = addr / PAGESIZE;
+    }
+    // Heap memory
+    fprintf(out, "\t\tHeap:\n");
+    addr = seg_start[HEAP_SEG];
+    while ((data = peek(pnum))) {
+        for (int i = addr%PAGESIZE; i < PAGESIZE; i += 8) {
+            uint64_t word = *(uint64_t *)(data + i);
+            if (word) {
+                fprintf(out, "\t\t\tAddress 0x%lx: 0x%lx\n", 
+                    addr+i, word);
+            }
+        }
+        addr += PAGESIZE;
+        pnum = addr / PAGESIZE;
+    }
+    // Stack memory
+    fprintf(out, "\t\tStack:\n");
+    addr = seg_start[STACK_SEG]-PAGESIZE;
+    addr -= addr % PAGESIZE;
+    pnum = addr / PAGESIZE;
+    while ((data = peek(pnum))) {
+        for (int i = addr%PAGESIZE; i < PAGESIZE; i += 8) {
+            uint64_t word = *(uint64_t *)(data + i);
+            if (word) {
+                fprintf(out, "\t\t\tAddress 0x%lx: 0x%lx\n", 
+                    addr+i, word);
+            }
+        }
+        addr -= PAGESIZE;
+        pnum = addr / PAGESIZE;
+    }
+}
@@ -26,6 +26,37 @@
 
 extern machine_t guest;
 
+uint64_t elf_pages_shared;
+uint64_t elf_pages_copied;
+
+/*
+ * Copy len bytes from the file mapping into guest memory at vaddr, a page
+ * at a time. A whole page whose source is page-aligned in the mapping is not
+ * copied at all: its PTE points into the mapping and is copied on the first
+ * guest write. The mapping is never unmapped, so those pages stay valid.
+ */
+static void load_bytes(uint64_t vaddr, const uint8_t *src, uint64_t len, 
+                       const uint8_t prot, const uint8_t *file_end) {
+    while (len > 0) {
+        uint64_t pnum = vaddr / PAGESIZE;
+        uint64_t poff = vaddr % PAGESIZE;
+        uint64_t n = PAGESIZE - poff;
+        if (n > len) n = len;
+        if (MEM_PTABLE == mem_backend && n == PAGESIZE && NULL == get_page(pnum) &&
+            ((uintptr_t) src % PAGESIZE) == 0 && src + PAGESIZE <= file_end) {
+            add_cow_page(pnum, prot, (const char *) src);
+            elf_pages_shared++;
+        }
+        else {
+            memcpy(mem_host_page(pnum, prot) + poff, src, n);
+            elf_pages_copied++;
+        }
+        vaddr += n;
+        src += n;
+        len -= n;
+    }
+}
+
 uint64_t loadElf(const char *fileName) {
     logging(LOG_INFO, "Loading ELF executable");
     // Open the file.
@@ -73,27 +104,18 @@ uint64_t loadElf(const char *fileName) {
             int write = !!(progHeader->p_flags & 0x2);
             int exec = !!(progHeader->p_flags & 0x1);
 
+            uint8_t prot = (read ? MEM_PROT_R : 0) | (write ? MEM_PROT_W : 0) | (exec ? MEM_PROT_X : 0);
+
             // Map data from the file for this segment
-            for (uint64_t j = 0; j < filesz + v_align; j++) {
-                uint64_t addr = vaddr + j;
-                uint8_t byte = dataPtr[j];
-                uint64_t pnum = addr / PAGESIZE;
-                uint64_t poff = addr % PAGESIZE;
-                pte_ptr_t page = get_page(pnum);
-                if (NULL == page)
-                    page = add_page(pnum, read | write << 1 | exec << 2);
-                page->p_data[poff] = byte;
-            }
+            load_bytes(vaddr, dataPtr, filesz + v_align, prot,
+                       (uint8_t *) ptr + statBuffer.st_size);
             // Map bss address space
-            // Data initialization to 0 happens indirectly through calloc() call in add_page().
+            // The pages are reserved against the shared zero page and only allocated when written.
             if (memsz > filesz) {
-                for (uint64_t j = 0; j < memsz - filesz; j++) {
-                    uint64_t addr = vaddr + f_align + j;
-                    uint64_t pnum = addr / PAGESIZE;
-                    pte_ptr_t page = get_page(pnum);
-                    if (NULL == page)
-                        page = add_page(pnum, read | write << 1 | exec << 2);
-                }
+                uint64_t bss_start = vaddr + f_align;
+                uint64_t bss_end = bss_start + (memsz - filesz);
+                for (uint64_t pnum = bss_start / PAGESIZE; pnum <= (bss_end - 1) / PAGESIZE; pnum++)
+                    mem_reserve_page(pnum, prot);
             }       
         }
         progHeader = (Elf64_Phdr *) (((uintptr_t) progHeader) + entry_size);
@@ -115,6 +137,7 @@ uint64_t loadElf(const char *fileName) {
         }
         sectionHeader = (Elf64_Shdr *) (((uintptr_t) sectionHeader) + entry_size);
     }
+    mem_update_segments();
 
     return entry;
 }
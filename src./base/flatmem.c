@@ -0,0 +1,60 @@
+/**************************************************************************
+ * C S 429 system emulator
+ * 
+ * flatmem.c - Module for the flat, host-mmap-backed guest memory backend.
+ * 
+ * Selected with -m flat. Regions are reserved with MAP_NORESERVE, so only
+ * the pages the guest actually touches cost host memory. Transparent huge
+ * pages are turned off for the regions so that "touched" keeps meaning
+ * the same thing as a materialized page in the page table backend.
+ * 
+ * Copyright (c) 2023.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/ 
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include "flatmem.h"
+#include "mem.h"
+#include "ptable.h"
+
+flat_region_t flat_regions[KERNEL_SEG];
+unsigned flat_num_regions;
+
+void init_flat_mem(const uint64_t *seg_starts) {
+    flat_num_regions = 0;
+    for (int i = TEXT_SEG; i < KERNEL_SEG; i++) {
+        uint64_t size = seg_starts[i+1] - seg_starts[i];
+        if (size > FLAT_MAX_REGION)
+            size = FLAT_MAX_REGION;
+        char *base = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (MAP_FAILED == base) {
+            perror("mmap");
+            exit(EXIT_FAILURE);
+        }
+#ifdef MADV_NOHUGEPAGE
+        madvise(base, size, MADV_NOHUGEPAGE);
+#endif
+        flat_regions[flat_num_regions].start = seg_starts[i];
+        flat_regions[flat_num_regions].size = size;
+        flat_regions[flat_num_regions].base = base;
+        flat_num_regions++;
+    }
+}
+
+bool flat_page_touched(const uint64_t addr) {
+    char *data = flat_translate(addr - addr % PAGESIZE);
+    unsigned char resident = 0;
+    if (NULL == data) return false;
+    if (mincore(data, PAGESIZE, &resident) != 0) return false;
+    return resident & 1;
+}
+
+void free_flat_mem(void) {
+    for (unsigned i = 0; i < flat_num_regions; i++)
+        munmap(flat_regions[i].base, flat_regions[i].size);
+    flat_num_regions = 0;
+}
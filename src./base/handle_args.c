@@ -13,6 +13,8 @@
 
 #include <getopt.h> // This does the job and keeps VSCode happy.
 #include "archsim.h"
+#include "mshr.h"
+#include "prefetch.h"
 
 static char printbuf[BUF_LEN];
 
@@ -27,8 +29,10 @@ void handle_args(int argc, char **argv) {
     B = -1;
     C = -1;
     d = -1;
+    icache_spec.A = -1;
+    wbuf_depth = 8;
 
-    while ((option = getopt(argc, argv, "i:o:c:l:v:A:B:C:d:")) != -1) {
+    while ((option = getopt(argc, argv, "i:o:c:l:v:A:B:C:d:P:L:F:I:M:p:W:Nb:V:sm:DK:fS:R:")) != -1) {
         switch(option) {
             case 'i':
                 infile_name = optarg;
@@ -90,6 +94,139 @@ void handle_args(int argc, char **argv) {
             case 'd':
                 d = atoi(optarg);
                 break;
+            case 'P': {
+                int policy = parse_repl_policy(optarg);
+                if (policy < 0) {
+                    assert(strlen(optarg) < BUF_LEN - 50);
+                    sprintf(printbuf, "Unknown replacement policy %s, using lru.", optarg);
+                    logging(LOG_INFO, printbuf);
+                }
+                else {
+                    repl_policy = policy;
+                }
+                break;
+            }
+            case 'L':
+                if (num_cache_levels + 1 >= MAX_CACHE_LEVELS) {
+                    sprintf(printbuf, "At most %d cache levels are supported.", MAX_CACHE_LEVELS);
+                    logging(LOG_FATAL, printbuf);
+                    return;
+                }
+                cache_spec_t *spec = &cache_levels[num_cache_levels++];
+                if (sscanf(optarg, "%d:%d:%d:%u", &spec->A, &spec->B, &spec->C, &spec->latency) != 4) {
+                    assert(strlen(optarg) < BUF_LEN - 50);
+                    sprintf(printbuf, "Expected -L A:B:C:latency, got %s", optarg);
+                    logging(LOG_FATAL, printbuf);
+                    return;
+                }
+                break;
+            case 'I':
+                if (sscanf(optarg, "%d:%d:%d", &icache_spec.A, &icache_spec.B, &icache_spec.C) != 3) {
+                    assert(strlen(optarg) < BUF_LEN - 50);
+                    sprintf(printbuf, "Expected -I A:B:C, got %s", optarg);
+                    logging(LOG_FATAL, printbuf);
+                    return;
+                }
+                break;
+            case 'M':
+                num_mshrs = atoi(optarg);
+                if (num_mshrs < 0 || num_mshrs > MAX_MSHRS) {
+                    sprintf(printbuf, "Expected 0 to %d MSHRs, got %d", MAX_MSHRS, num_mshrs);
+                    logging(LOG_FATAL, printbuf);
+                    return;
+                }
+                break;
+            case 'p': {
+                int kind = parse_prefetcher(optarg);
+                if (kind < 0) {
+                    assert(strlen(optarg) < BUF_LEN - 50);
+                    sprintf(printbuf, "Unknown prefetcher %s, using none.", optarg);
+                    logging(LOG_INFO, printbuf);
+                }
+                else {
+                    prefetch_kind = kind;
+                }
+                break;
+            }
+            case 'W':
+                if (!strcmp(optarg, "back")) {
+                    write_through = false;
+                }
+                else if (!strcmp(optarg, "through")) {
+                    write_through = true;
+                }
+                else {
+                    assert(strlen(optarg) < BUF_LEN - 50);
+                    sprintf(printbuf, "Unknown write policy %s, using back.", optarg);
+                    logging(LOG_INFO, printbuf);
+                }
+                break;
+            case 'N':
+                no_write_allocate = true;
+                break;
+            case 'b':
+                wbuf_depth = atoi(optarg);
+                if (wbuf_depth < 1 || wbuf_depth > WBUF_ENTRIES) {
+                    sprintf(printbuf, "Expected 1 to %d write buffer entries, got %d", WBUF_ENTRIES, wbuf_depth);
+                    logging(LOG_FATAL, printbuf);
+                    return;
+                }
+                break;
+            case 'V':
+                victim_lines = atoi(optarg);
+                if (victim_lines < 1 || victim_lines > VICTIM_MAX) {
+                    sprintf(printbuf, "Expected 1 to %d victim cache lines, got %d", VICTIM_MAX, victim_lines);
+                    logging(LOG_FATAL, printbuf);
+                    return;
+                }
+                break;
+            case 'F':
+                if (!strcmp(optarg, "nine")) {
+                    fill_policy = FILL_NINE;
+                }
+                else if (!strcmp(optarg, "inclusive")) {
+                    fill_policy = FILL_INCLUSIVE;
+                }
+                else if (!strcmp(optarg, "exclusive")) {
+                    fill_policy = FILL_EXCLUSIVE;
+                }
+                else {
+                    assert(strlen(optarg) < BUF_LEN - 50);
+                    sprintf(printbuf, "Unknown fill policy %s, using nine.", optarg);
+                    logging(LOG_INFO, printbuf);
+                }
+                break;
+            case 's':
+                print_stats = true;
+                break;
+            case 'D':
+                incremental_checkpoints = true;
+                break;
+            case 'K':
+                checkpoint_interval = atol(optarg);
+                break;
+            case 'f':
+                flush_checkpoints = true;
+                break;
+            case 'S':
+                snapshot_save_name = optarg;
+                break;
+            case 'R':
+                snapshot_restore_name = optarg;
+                break;
+            case 'm':
+                if (!strcmp(optarg, "flat")) {
+                    mem_backend = MEM_FLAT;
+                }
+                else if (!strcmp(optarg, "ptable")) {
+                    mem_backend = MEM_PTABLE;
+                }
+                else {
+                    assert(strlen(optarg) < BUF_LEN - 50);
+                    sprintf(printbuf, "Unknown memory backend %s, using ptable.", optarg);
+                    logging(LOG_INFO, printbuf);
+                }
+                break;
             default:
                 sprintf(printbuf, "Ignoring unknown option %c", optopt);
                 logging(LOG_INFO, printbuf);
@@ -99,11 +236,50 @@ void handle_args(int argc, char **argv) {
     if (A == -1 || B == -1 || C == -1 || d == -1) {
         sprintf(printbuf, "Missing arguments for cache creation, running without cache.");
         logging(LOG_INFO, printbuf);
+        if (num_cache_levels) {
+            sprintf(printbuf, "Ignoring -L, which needs a first-level cache.");
+            logging(LOG_INFO, printbuf);
+            num_cache_levels = 0;
+        }
+        if (icache_spec.A != -1) {
+            sprintf(printbuf, "Ignoring -I, which needs a first-level cache.");
+            logging(LOG_INFO, printbuf);
+            icache_spec.A = -1;
+        }
+        if (num_mshrs) {
+            sprintf(printbuf, "Ignoring -M, which needs a first-level cache.");
+            logging(LOG_INFO, printbuf);
+            num_mshrs = 0;
+        }
+        if (prefetch_kind) {
+            sprintf(printbuf, "Ignoring -p, which needs a first-level cache.");
+            logging(LOG_INFO, printbuf);
+            prefetch_kind = PF_NONE;
+        }
+        if (write_through || no_write_allocate) {
+            sprintf(printbuf, "Ignoring -W and -N, which need a first-level cache.");
+            logging(LOG_INFO, printbuf);
+            write_through = no_write_allocate = false;
+        }
+        if (victim_lines) {
+            sprintf(printbuf, "Ignoring -V, which needs a first-level cache.");
+            logging(LOG_INFO, printbuf);
+            victim_lines = 0;
+        }
+    }
+    else if (!repl_policy_supported(repl_policy, A)) {
+        sprintf(printbuf, "Policy %s does not support A=%d.", repl_policy_name(repl_policy), A);
+        logging(LOG_FATAL, printbuf);
+        return;
     }
     else {
         sprintf(printbuf, "Running with cache.");
         logging(LOG_INFO, printbuf);
     }
+    if (incremental_checkpoints && MEM_FLAT == mem_backend) {
+        sprintf(printbuf, "Incremental checkpoints need the ptable backend, writing full checkpoints.");
+        logging(LOG_INFO, printbuf);
+    }
     for(; optind < argc; optind++) { // when some extra arguments are passed
         assert(strlen(argv[optind])< BUF_LEN);
         sprintf(printbuf, "Ignoring extra argument %s", argv[optind]);
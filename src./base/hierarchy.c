@@ -0,0 +1,380 @@
+/**************************************************************************
+ * C S 429 system emulator
+ *
+ * hierarchy.c - Module for the levels of cache below the L1 data cache.
+ *
+ * The first level is still driven by check_hit() and handle_miss() from
+ * mem.c, so its counters are the ones the checkpoints report. This module
+ * takes over once the first level misses: it finds the level that holds
+ * the block, charges that level's latency, and on the last cycle of the
+ * miss moves the block up. Blocks evicted on the way are written down one
+ * level at a time, ending in memory.
+ *
+ * The optional L1 instruction cache sits beside the first level and shares
+ * the levels below it. Nothing writes to it, so its victims are dropped.
+ *
+ * Stores the first level does not keep (write-through, or a miss without
+ * write-allocate) are written below straight away and queued in the write
+ * buffer, which drains one block per next-level latency. Each level counts
+ * the bytes it moves to and from the level below.
+ *
+ * Copyright (c) 2023.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "archsim.h"
+#include "hierarchy.h"
+#include "prefetch.h"
+
+extern uint64_t num_instr;
+
+hierarchy_t hierarchy;
+
+static char printbuf[BUF_LEN];
+
+static void init_level(cache_level_t *level, const char *name, cache_t *cache, unsigned latency) {
+    memset(level, 0, sizeof(*level));
+    strncpy(level->name, name, sizeof(level->name) - 1);
+    level->cache = cache;
+    level->latency = latency;
+    level->victim_data = malloc(cache->B);
+}
+
+bool init_hierarchy(cache_t *l1, unsigned mem_latency, const cache_spec_t *specs, int n, fill_policy_t fill) {
+    if (n + 1 > MAX_CACHE_LEVELS) {
+        sprintf(printbuf, "At most %d cache levels are supported.", MAX_CACHE_LEVELS);
+        logging(LOG_FATAL, printbuf);
+        return false;
+    }
+    hierarchy.num_levels = n + 1;
+    hierarchy.fill = fill;
+    hierarchy.mem_latency = mem_latency;
+    hierarchy.fill_data = malloc(l1->B);
+    hierarchy.write_through = false;
+    hierarchy.write_allocate = true;
+    init_level(&hierarchy.levels[0], "L1D", l1, 0);
+    for (int i = 0; i < n; i++) {
+        if (specs[i].B != (int) l1->B) {
+            logging(LOG_FATAL, "All cache levels need the same block size.");
+            return false;
+        }
+        if (!repl_policy_supported(repl_policy, specs[i].A)) {
+            sprintf(printbuf, "Policy %s does not support A=%d.", repl_policy_name(repl_policy), specs[i].A);
+            logging(LOG_FATAL, printbuf);
+            return false;
+        }
+        char name[4];
+        snprintf(name, sizeof(name), "L%d", i + 2);
+        init_level(&hierarchy.levels[i + 1], name,
+                   create_cache(specs[i].A, specs[i].B, specs[i].C, specs[i].latency), specs[i].latency);
+    }
+    return true;
+}
+
+bool init_icache(const cache_spec_t *spec) {
+    if (spec->B != (int) hierarchy.levels[0].cache->B) {
+        logging(LOG_FATAL, "All cache levels need the same block size.");
+        return false;
+    }
+    if (!repl_policy_supported(repl_policy, spec->A)) {
+        sprintf(printbuf, "Policy %s does not support A=%d.", repl_policy_name(repl_policy), spec->A);
+        logging(LOG_FATAL, printbuf);
+        return false;
+    }
+    init_level(&hierarchy.icache, "L1I", create_cache(spec->A, spec->B, spec->C, hierarchy.mem_latency), 0);
+    return true;
+}
+
+bool init_write_policy(bool write_through, bool write_allocate, int depth) {
+    hierarchy.write_through = write_through;
+    hierarchy.write_allocate = write_allocate;
+    memset(&hierarchy.wbuf, 0, sizeof(hierarchy.wbuf));
+    if (!write_through && write_allocate)
+        return true;
+    if (hierarchy.levels[0].cache->B > WBUF_MAX_B) {
+        sprintf(printbuf, "The write buffer needs B <= %d.", WBUF_MAX_B);
+        logging(LOG_FATAL, printbuf);
+        return false;
+    }
+    hierarchy.wbuf.depth = depth;
+    hierarchy.store_data = malloc(hierarchy.levels[0].cache->B);
+    return true;
+}
+
+unsigned hierarchy_miss_latency(uint64_t block) {
+    for (int i = 1; i < hierarchy.num_levels; i++) {
+        if (cache_find(hierarchy.levels[i].cache, block) >= 0)
+            return hierarchy.levels[i].latency;
+    }
+    return hierarchy.mem_latency;
+}
+
+static void write_down(int level, uint64_t addr, byte_t *data, bool dirty);
+
+/*
+ * A valid block has left the given level. Under the inclusive policy it
+ * leaves the levels above too, and a dirty copy there is the newest data.
+ * Then it goes one level down: always under the exclusive policy (where
+ * the next level is the victim cache of this one), and only if dirty
+ * otherwise.
+ */
+static void evicted(int level, evicted_line_t *victim) {
+    if (!victim->valid)
+        return;
+    if (FILL_INCLUSIVE == hierarchy.fill && level > 0) {
+        if (hierarchy.icache.cache) {
+            long line = cache_find(hierarchy.icache.cache, victim->addr);
+            if (line >= 0)
+                cache_invalidate(hierarchy.icache.cache, line);
+        }
+        // Nearest the processor last, as that copy is the newest.
+        for (int i = level - 1; i >= 0; i--) {
+            cache_t *above = hierarchy.levels[i].cache;
+            long line = cache_find(above, victim->addr);
+            if (line < 0)
+                continue;
+            if (above->dirty[line]) {
+                memcpy(victim->data, above->data + line * above->B, above->B);
+                victim->dirty = true;
+            }
+            cache_invalidate(above, line);
+        }
+        victim_cache_t *v = hierarchy.levels[0].cache->victim;
+        long i = v ? victim_find(hierarchy.levels[0].cache, victim->addr) : -1;
+        if (i >= 0) {
+            if (v->dirty[i]) {
+                memcpy(victim->data, v->data + i * hierarchy.levels[0].cache->B, hierarchy.levels[0].cache->B);
+                victim->dirty = true;
+            }
+            v->valid[i] = v->dirty[i] = false;
+        }
+    }
+    if (victim->dirty || (FILL_EXCLUSIVE == hierarchy.fill && level + 1 < hierarchy.num_levels)) {
+        hierarchy.levels[level].writebacks += victim->dirty;
+        hierarchy.levels[level].write_bytes += hierarchy.levels[level].cache->B;
+        write_down(level + 1, victim->addr, victim->data, victim->dirty);
+    }
+}
+
+// Put a block into a level, or into memory below the last level.
+static void write_down(int level, uint64_t addr, byte_t *data, bool dirty) {
+    if (level == hierarchy.num_levels) {
+        mem_write_block(addr, data, hierarchy.levels[0].cache->B);
+        return;
+    }
+    cache_level_t *l = &hierarchy.levels[level];
+    long line = cache_find(l->cache, addr);
+    if (line >= 0) {
+        memcpy(l->cache->data + line * l->cache->B, data, l->cache->B);
+        l->cache->dirty[line] |= dirty;
+        return;
+    }
+    evicted_line_t victim = {.data = l->victim_data};
+    cache_insert(l->cache, addr, data, dirty, &victim);
+    evicted(level, &victim);
+}
+
+/*
+ * Copy a block that missed in a first-level cache into hierarchy.fill_data,
+ * from the nearest level below that has it or from memory, and fill the
+ * levels it missed in. Returns whether the copy taken out of an exclusive
+ * level was dirty. The I-cache cannot hold a dirty block, so for it
+ * (take == false) an exclusive level keeps its copy.
+ */
+static bool fetch_block(uint64_t block, bool take) {
+    byte_t *data = hierarchy.fill_data;
+    bool dirty = false;
+
+    // Find the block, counting a miss at every level it is not in.
+    int found = 1;
+    for (; found < hierarchy.num_levels; found++) {
+        cache_level_t *l = &hierarchy.levels[found];
+        long line = cache_find(l->cache, block);
+        if (line < 0) {
+            l->misses++;
+            continue;
+        }
+        l->hits++;
+        memcpy(data, l->cache->data + line * l->cache->B, l->cache->B);
+        if (FILL_EXCLUSIVE == hierarchy.fill && take) {
+            dirty = l->cache->dirty[line];
+            cache_invalidate(l->cache, line);
+        }
+        else {
+            cache_touch(l->cache, block, line);
+        }
+        break;
+    }
+    if (found == hierarchy.num_levels)
+        mem_read_block(block, data, hierarchy.levels[0].cache->B);
+
+    // Fill the levels it missed in, lowest first, so that an inclusive
+    // level never holds a block its own fill is about to back-invalidate.
+    if (FILL_EXCLUSIVE != hierarchy.fill) {
+        for (int i = found - 1; i >= 1; i--) {
+            cache_level_t *l = &hierarchy.levels[i];
+            evicted_line_t victim = {.data = l->victim_data};
+            l->read_bytes += l->cache->B;
+            cache_insert(l->cache, block, data, false, &victim);
+            evicted(i, &victim);
+        }
+    }
+    return dirty;
+}
+
+void hierarchy_fill(uint64_t block, operation_t op) {
+    cache_t *l1 = hierarchy.levels[0].cache;
+    bool dirty = fetch_block(block, true);
+    hierarchy.levels[0].read_bytes += l1->B;
+    evicted_line_t victim = {.data = hierarchy.levels[0].victim_data};
+    handle_miss(l1, block, op, hierarchy.fill_data, &victim);
+    if (prefetcher.kind)
+        prefetch_filled(cache_find(l1, block));
+    if (dirty)
+        l1->dirty[cache_find(l1, block)] = true;
+    evicted(0, &victim);
+}
+
+void hierarchy_fill_icache(uint64_t block) {
+    cache_level_t *l1i = &hierarchy.icache;
+    fetch_block(block, false);
+    l1i->read_bytes += l1i->cache->B;
+    evicted_line_t victim = {.data = l1i->victim_data};
+    cache_insert(l1i->cache, block, hierarchy.fill_data, false, &victim);
+}
+
+// Cycles the write buffer takes to write one block to the level below.
+static unsigned drain_latency(void) {
+    return hierarchy.num_levels > 1 ? hierarchy.levels[1].latency : hierarchy.mem_latency;
+}
+
+static wbuf_entry_t *wbuf_find(uint64_t block) {
+    write_buffer_t *wb = &hierarchy.wbuf;
+    for (int i = 0; i < wb->count; i++) {
+        wbuf_entry_t *e = &wb->entries[(wb->head + i) % wb->depth];
+        if (e->block == block)
+            return e;
+    }
+    return NULL;
+}
+
+bool write_buffer_room(uint64_t block) {
+    return hierarchy.wbuf.count < hierarchy.wbuf.depth || wbuf_find(block);
+}
+
+void hierarchy_store(uint64_t addr, uint64_t data) {
+    cache_t *l1 = hierarchy.levels[0].cache;
+    uint64_t block = addr & ~(uint64_t) (l1->B - 1);
+    byte_t *val = (byte_t *) &data;
+
+    // The nearest level that has the block takes the store, else memory.
+    byte_t *dest = NULL;
+    for (int i = 1; i < hierarchy.num_levels && !dest; i++) {
+        cache_t *cache = hierarchy.levels[i].cache;
+        long line = cache_find(cache, block);
+        if (line >= 0) {
+            dest = cache->data + line * cache->B;
+            cache->dirty[line] = true;
+        }
+    }
+    if (!dest) {
+        dest = hierarchy.store_data;
+        mem_read_block(block, dest, l1->B);
+    }
+
+    write_buffer_t *wb = &hierarchy.wbuf;
+    wbuf_entry_t *e = wbuf_find(block);
+    if (e) {
+        wb->coalesced++;
+    }
+    else {
+        if (!wb->count)
+            wb->next_drain = num_instr + drain_latency();
+        e = &wb->entries[(wb->head + wb->count++) % wb->depth];
+        memset(e, 0, sizeof(*e));
+        e->block = block;
+    }
+    wb->stores++;
+    // The same 8 bytes, wrapping within the block, as set_word_cache().
+    for (int i = 0; i < 8; i++) {
+        unsigned offset = (addr + i) & l1->off_mask;
+        dest[offset] = val[i];
+        e->mask[offset / 64] |= 1ULL << (offset % 64);
+    }
+    if (dest == hierarchy.store_data)
+        mem_write_block(block, dest, l1->B);
+}
+
+static void wbuf_pop(void) {
+    write_buffer_t *wb = &hierarchy.wbuf;
+    wbuf_entry_t *e = &wb->entries[wb->head];
+    for (int i = 0; i < WBUF_MAX_B / 64; i++)
+        hierarchy.levels[0].write_bytes += __builtin_popcountll(e->mask[i]);
+    wb->head = (wb->head + 1) % wb->depth;
+    wb->count--;
+}
+
+void write_buffer_tick(uint64_t now) {
+    write_buffer_t *wb = &hierarchy.wbuf;
+    if (!wb->count || wb->next_drain > now)
+        return;
+    wbuf_pop();
+    wb->next_drain = now + drain_latency();
+}
+
+void write_buffer_drain(void) {
+    while (hierarchy.wbuf.count)
+        wbuf_pop();
+}
+
+// Lowest level first, so that the newest copy of a block is written last.
+void hierarchy_write_back(void) {
+    for (int l = hierarchy.num_levels - 1; l >= 0; l--) {
+        cache_t *c = hierarchy.levels[l].cache;
+        for (long i = 0; i < (long) c->S * c->A; i++) {
+            if (c->valid[i] && c->dirty[i])
+                mem_write_block(cache_line_addr(c, i), c->data + i * c->B, c->B);
+        }
+    }
+    cache_t *l1 = hierarchy.levels[0].cache;
+    victim_cache_t *v = l1->victim;
+    for (unsigned int i = 0; v && i < v->lines; i++) {
+        if (v->valid[i] && v->dirty[i])
+            mem_write_block(v->addrs[i], v->data + i * l1->B, l1->B);
+    }
+}
+
+void log_hierarchy_stats(FILE *out) {
+    extern int hit_count;
+    extern int miss_count;
+    hierarchy.levels[0].hits = hit_count;
+    hierarchy.levels[0].misses = miss_count;
+    for (int i = 0; i < hierarchy.num_levels; i++) {
+        cache_level_t *l = &hierarchy.levels[i];
+        fprintf(out, "\t%s (A=%u B=%u C=%u, %u cycles): hits %lu, misses %lu, writebacks %lu\n",
+                l->name, l->cache->A, l->cache->B, l->cache->C, l->latency, l->hits, l->misses, l->writebacks);
+        fprintf(out, "\t\tbytes from below %lu, to below %lu\n", l->read_bytes, l->write_bytes);
+        if (l->cache->victim) {
+            victim_cache_t *v = l->cache->victim;
+            fprintf(out, "\t\tvictim cache of %u lines: hits %lu, misses %lu (hit rate %.1f%%)\n", v->lines,
+                    v->hits, v->misses, v->hits + v->misses ? 100.0 * v->hits / (v->hits + v->misses) : 0.0);
+        }
+        if (0 == i && hierarchy.wbuf.depth) {
+            write_buffer_t *wb = &hierarchy.wbuf;
+            fprintf(out, "\t\twrite-%s, %s; write buffer of %d: stores %lu, coalesced %lu, cycles full %lu\n",
+                    hierarchy.write_through ? "through" : "back",
+                    hierarchy.write_allocate ? "write-allocate" : "no-write-allocate",
+                    wb->depth, wb->stores, wb->coalesced, wb->full_stalls);
+        }
+        if (0 == i && hierarchy.icache.cache) {
+            cache_level_t *l1i = &hierarchy.icache;
+            fprintf(out, "\t%s (A=%u B=%u C=%u): hits %lu, misses %lu\n",
+                    l1i->name, l1i->cache->A, l1i->cache->B, l1i->cache->C, l1i->hits, l1i->misses);
+            fprintf(out, "\t\tbytes from below %lu\n", l1i->read_bytes);
+        }
+    }
+    fprintf(out, "\tMemory (%u cycles)\n", hierarchy.mem_latency);
+}
@@ -25,7 +25,13 @@ comb_logic_t
 imem(uint64_t imem_addr,
      uint32_t *imem_rval, bool *imem_err) {
     // imem_addr must be in "instruction memory" and a multiple of 4
-    *imem_err = (!addr_in_imem(imem_addr) || (imem_addr & 0x3U));
+    *imem_err = (!addr_in_imem(imem_addr) || (imem_addr & 0x3U) ||
+                 !mem_access_ok(imem_addr, 4, MEM_PROT_X));
+    // On an I-cache miss the instruction is not here yet; fetch retries.
+    if (guest.icache && !*imem_err && !mem_fetch_ready(imem_addr)) {
+        *imem_rval = 0;
+        return;
+    }
     *imem_rval = (uint32_t) mem_read_I(imem_addr);
 }
 
@@ -137,7 +143,8 @@ comb_logic_t
 dmem(uint64_t dmem_addr, uint64_t dmem_wval, bool dmem_read, bool dmem_write, 
      uint64_t *dmem_rval, bool *dmem_err) {
     // dmem_addr must be in "data memory" and a multiple of 8
-    *dmem_err = (!addr_in_dmem(dmem_addr) || (dmem_addr & 0x7U));
+    *dmem_err = (!addr_in_dmem(dmem_addr) || (dmem_addr & 0x7U) ||
+                 !mem_access_ok(dmem_addr, 8, (dmem_read ? MEM_PROT_R : 0) | (dmem_write ? MEM_PROT_W : 0)));
     if (is_special_addr(dmem_addr)) *dmem_err = false;
     if (dmem_read) *dmem_rval = (uint64_t) mem_read_L(dmem_addr);
     if (dmem_write) mem_write_L(dmem_addr, dmem_wval);
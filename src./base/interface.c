@@ -13,6 +13,8 @@
 
 #include "archsim.h"
 #include "ansicolors.h"
+#include "ptable.h"
+#include "flatmem.h"
 
 static char default_ae_prompt[] = ANSI_BOLD ANSI_COLOR_BLUE "UTCS429-S2023-archsim>>> " ANSI_RESET;
 static const char author[] = ANSI_BOLD ANSI_COLOR_RED "Reference Implementation" ANSI_RESET;
@@ -42,6 +44,12 @@ void init(void) {
 }
 
 void finalize() {
+    if (snapshot_save_name) {
+        save_snapshot(snapshot_save_name);
+    }
+    if (print_stats) {
+        log_machine_stats(outfile);
+    }
     if (outfile == stdout)  {
         time_t t;
         assert(time(&t) != -1);
@@ -51,5 +59,9 @@ void finalize() {
     if (checkpoint) {
         log_machine_state();
     }
+    if (MEM_FLAT == mem_backend) {
+        free_flat_mem();
+    }
+    free_ptable();
     return;
 }
@@ -13,17 +13,40 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "machine.h"
 #include "ptable.h"
+#include "tlb.h"
+#include "flatmem.h"
+#include "elf_loader.h"
+#include "checkpoint.h"
+#include "hierarchy.h"
+#include "mshr.h"
+#include "mshr.h"
+#include "prefetch.h"
 
 /* Created from command-line arguments */
 extern FILE *checkpoint;
 extern int A, B, C, d;
+extern cache_spec_t cache_levels[];
+extern int num_cache_levels;
+extern fill_policy_t fill_policy;
+extern cache_spec_t icache_spec;
+extern int num_mshrs;
+extern prefetcher_kind_t prefetch_kind;
+extern bool write_through;
+extern bool no_write_allocate;
+extern int wbuf_depth;
+extern int victim_lines;
 extern uint64_t inflight_cycles;
 extern uint64_t inflight_addr;
 extern bool inflight;
 extern mem_status_t dmem_status;
+extern bool imem_inflight;
+extern mem_status_t imem_status;
 extern uint64_t num_instr;
+extern bool incremental_checkpoints;
+extern bool flush_checkpoints;
 
 // These may be changed by the ELF loader
 uint64_t seg_starts[] = {
@@ -36,6 +59,7 @@ uint64_t seg_starts[] = {
     0x1000000000000ULL
 };
 
+// Bits are MEM_PROT_R (4), MEM_PROT_W (2), and MEM_PROT_X (1).
 static uint8_t seg_prots[] = {0x0, 0x5, 0x6, 0x6, 0x5, 0x6, 0x0};
 
 extern machine_t guest;
@@ -65,15 +89,34 @@ void init_machine(char *name, unsigned word_size, byte_order_t code_order, byte_
         guest.mem->seg_start_addr[i] = seg_starts[i];
         guest.mem->seg_prot[i] = seg_prots[i];
     }
+    mem_update_segments();
+    if (MEM_FLAT == mem_backend)
+        init_flat_mem(seg_starts);
+    guest.icache = NULL;
     if (A == -1 || B == -1 || C == -1 || d == -1) {
         guest.cache = NULL;
     }
     else {
         guest.cache = create_cache(A, B, C, d);
+        if (victim_lines)
+            cache_add_victim(guest.cache, victim_lines);
+        if (!init_hierarchy(guest.cache, d, cache_levels, num_cache_levels, fill_policy))
+            exit(EXIT_FAILURE);
+        if (icache_spec.A != -1) {
+            if (!init_icache(&icache_spec))
+                exit(EXIT_FAILURE);
+            guest.icache = hierarchy.icache.cache;
+        }
+        init_mshrs(num_mshrs);
+        init_prefetcher(prefetch_kind, guest.cache->C / guest.cache->B);
+        if (!init_write_policy(write_through, !no_write_allocate, wbuf_depth))
+            exit(EXIT_FAILURE);
         inflight_cycles = guest.cache->d;
         inflight_addr = 0;
         inflight = false;
         dmem_status = READY;
+        imem_inflight = false;
+        imem_status = READY;
     }
 }
 
@@ -97,6 +140,39 @@ static void get_stat_str(char *str, stat_t status) {
     }
 }
 
+static int cmp_pnum(const void *a, const void *b) {
+    uint64_t x = (*(const pte_ptr_t *) a)->p_num;
+    uint64_t y = (*(const pte_ptr_t *) b)->p_num;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Incremental form of the memory state: the segment starts, then every page
+ * created or written since the previous checkpoint with its nonzero words.
+ * The first checkpoint of a run lists every page. ckpt-merge turns a run of
+ * these back into full checkpoints.
+ */
+static void log_mem_delta(FILE *out) {
+    uint64_t n;
+    pte_ptr_t *pages = dirty_pages(&n);
+    qsort(pages, n, sizeof(pte_ptr_t), cmp_pnum);
+    fprintf(out, CKPT_DELTA_HEADER);
+    fprintf(out, "\t\tSegment starts:");
+    for (int i = 0; i <= KERNEL_SEG; i++)
+        fprintf(out, " 0x%lx", guest.mem->seg_start_addr[i]);
+    fprintf(out, "\n");
+    for (uint64_t j = 0; j < n; j++) {
+        uint64_t addr = pages[j]->p_num * PAGESIZE;
+        fprintf(out, "\t\tPage 0x%lx:\n", pages[j]->p_num);
+        for (int i = 0; i < PAGESIZE; i += 8) {
+            uint64_t word = *(uint64_t *)(pages[j]->p_data + i);
+            if (word)
+                fprintf(out, "\t\t\tAddress 0x%lx: 0x%lx\n", addr+i, word);
+        }
+    }
+    clean_pages();
+}
+
 void log_machine_state() {
     if (checkpoint) {
         fprintf(checkpoint, "Machine state checkpoint after %ld cycles:\n", num_instr);
@@ -120,85 +196,56 @@ void log_machine_state() {
         get_stat_str(buf, guest.proc->status);
         fprintf(checkpoint, "\t\tStatus: %s\n", buf);
         // Log memory state
-        fprintf(checkpoint, "\tMemory state:\n");
-        /* 
-         * .text section
-         * This isn't really needed since students don't 
-         * write the ELF Loader and shouldn't modify the
-         * instructions, but it was useful for debugging.
-         */
-        fprintf(checkpoint, "\t\tText segment:\n");
-        pte_ptr_t page;
-        uint64_t addr = guest.mem->seg_start_addr[TEXT_SEG];
-        addr -= addr % PAGESIZE;
-        uint64_t pnum = addr / PAGESIZE;
-        while ((page = get_page(pnum))) {
-            for (int i = 0; i < PAGESIZE; i += 8) {
-                uint64_t data = *(uint64_t *)(page->p_data + i);
-                if (data) {
-                    fprintf(checkpoint, "\t\t\tAddress 0x%lx: 0x%lx\n", 
-                        addr+i, data);
-                }
-            }
-            addr += PAGESIZE;
-            pnum = addr / PAGESIZE;
-        }
-        // .data section
-        fprintf(checkpoint, "\t\tData segment:\n");
-        addr = guest.mem->seg_start_addr[DATA_SEG];
-        addr -= addr % PAGESIZE;
-        pnum = addr / PAGESIZE;
-        while ((page = get_page(pnum))) {
-            for (int i = 0; i < PAGESIZE; i += 8) {
-                uint64_t data = *(uint64_t *)(page->p_data + i);
-                if (data) {
-                    fprintf(checkpoint, "\t\t\tAddress 0x%lx: 0x%lx\n", 
-                        addr+i, data);
-                }
-            }
-            addr += PAGESIZE;
-            pnum = addr / PAGESIZE;
-        }
-        // Heap memory
-        fprintf(checkpoint, "\t\tHeap:\n");
-        addr = guest.mem->seg_start_addr[HEAP_SEG];
-        while ((page = get_page(pnum))) {
-            for (int i = addr%PAGESIZE; i < PAGESIZE; i += 8) {
-                uint64_t data = *(uint64_t *)(page->p_data + i);
-                if (data) {
-                    fprintf(checkpoint, "\t\t\tAddress 0x%lx: 0x%lx\n", 
-                        addr+i, data);
-                }
-            }
-            addr += PAGESIZE;
-            pnum = addr / PAGESIZE;
-        }
-        // Stack memory
-        fprintf(checkpoint, "\t\tStack:\n");
-        addr = guest.mem->seg_start_addr[STACK_SEG]-PAGESIZE;
-        addr -= addr % PAGESIZE;
-        pnum = addr / PAGESIZE;
-        while ((page = get_page(pnum))) {
-            for (int i = addr%PAGESIZE; i < PAGESIZE; i += 8) {
-                uint64_t data = *(uint64_t *)(page->p_data + i);
-                if (data) {
-                    fprintf(checkpoint, "\t\t\tAddress 0x%lx: 0x%lx\n", 
-                        addr+i, data);
-                }
-            }
-            addr -= PAGESIZE;
-            pnum = addr / PAGESIZE;
+        if (flush_checkpoints && guest.cache) {
+            hierarchy_write_back();
+            mshr_write_back();
         }
+        if (incremental_checkpoints && MEM_PTABLE == mem_backend)
+            log_mem_delta(checkpoint);
+        else
+            log_mem_state(checkpoint, guest.mem->seg_start_addr, mem_peek_page);
         extern int hit_count;
         extern int miss_count;
-        int hits, misses;
-        // mem.c code for this gives extra hits and misses
         if (guest.cache) {
-            misses = miss_count / guest.cache->d;
-            hits = hit_count-misses;
-            fprintf(checkpoint, "\t\tNumber of cache hits, misses: %d, %d\n", hits, misses);
+            fprintf(checkpoint, "\t\tNumber of cache hits, misses: %d, %d\n", hit_count, miss_count);
+        }
+        if (guest.cache && guest.cache->victim) {
+            fprintf(checkpoint, "\t\tNumber of victim cache hits, misses: %lu, %lu\n",
+                    guest.cache->victim->hits, guest.cache->victim->misses);
+        }
+        if (guest.icache) {
+            fprintf(checkpoint, "\t\tNumber of I-cache hits, misses: %lu, %lu\n",
+                    hierarchy.icache.hits, hierarchy.icache.misses);
         }
 
         fprintf(checkpoint, "\n");
     }
 }
+
+/*
+ * Summary of emulator (host-side) statistics, printed at exit with -s.
+ * None of these affect the guest-visible machine state.
+ */
+void log_machine_stats(FILE *out) {
+    double secs = (double) clock() / CLOCKS_PER_SEC;
+    fprintf(out, "Emulator statistics after %ld cycles:\n", num_instr);
+    fprintf(out, "\tMemory backend: %s\n", MEM_FLAT == mem_backend ? "flat" : "ptable");
+    fprintf(out, "\tHost CPU time: %.3f s (%.0f cycles/s)\n", secs, secs > 0 ? num_instr / secs : 0.0);
+    fprintf(out, "\tSoftware TLB hits, misses: %lu, %lu\n", tlb_hits, tlb_misses);
+    fprintf(out, "\tZero-page mappings (page allocations avoided): %lu\n", zero_pages);
+    fprintf(out, "\tCopy-on-write page copies: %lu\n", cow_copies);
+    fprintf(out, "\tELF pages shared with the file, copied: %lu, %lu\n", elf_pages_shared, elf_pages_copied);
+    fprintf(out, "\tPage arena: %lu chunks (%lu KiB), %lu frames, %lu table nodes, %lu PTEs in %lu blocks\n",
+            arena_stats.chunks, arena_stats.chunks * (ARENA_CHUNK_SIZE >> 10), arena_stats.frames, arena_stats.nodes,
+            arena_stats.ptes, arena_stats.pte_blocks);
+    if (guest.cache) {
+        fprintf(out, "\tCache hierarchy (%s fill):\n", FILL_EXCLUSIVE == hierarchy.fill ? "exclusive" :
+                FILL_INCLUSIVE == hierarchy.fill ? "inclusive" : "nine");
+        log_hierarchy_stats(out);
+        if (mshrs.num)
+            log_mshr_stats(out);
+        if (prefetcher.kind)
+            log_prefetch_stats(out);
+    }
+    fprintf(out, "\n");
+}
@@ -16,17 +16,28 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <string.h>
 #include "err_handler.h"
 #include "mem.h"
 #include "ptable.h"
+#include "tlb.h"
+#include "flatmem.h"
 #include "machine.h"
+#include "hierarchy.h"
+#include "mshr.h"
+#include "prefetch.h"
 
 extern machine_t guest;
 extern uint64_t inflight_cycles;
 extern uint64_t inflight_addr;
 extern bool inflight;
 extern mem_status_t dmem_status;
-extern uint64_t seg_starts[];
+extern uint64_t imem_inflight_cycles;
+extern uint64_t imem_inflight_addr;
+extern bool imem_inflight;
+extern mem_status_t imem_status;
+extern uint64_t num_instr;
+extern int miss_count;
 
 const uint64_t NULL_ADDR = 0x0UL;
 const uint64_t IO_CHAR_ADDR = 0xFFFFFFFFFFFFFFFFUL;
@@ -34,14 +45,75 @@ const uint64_t IO_CHAR_ADDR = 0xFFFFFFFFFFFFFFFFUL;
 const uint64_t RET_FROM_MAIN_ADDR = 0x0UL;
 const uint64_t CHECKPOINT_ADDR = 0xFFFFFFFFFFFFFFFFUL-8;
 
+mem_backend_t mem_backend = MEM_PTABLE;
+
+/*
+ * Segment map: the segment start addresses sorted ascending, each with the
+ * segment that owns the range up to the next start. The stack gets a second
+ * entry STACK_LIMIT below its start, since it grows down into that range.
+ * Lookups are a binary search, and mem_update_segments() rebuilds the map
+ * whenever guest.mem->seg_start_addr changes.
+ */
+#define SEG_MAP_SIZE (KERNEL_SEG + 2)
+static uint64_t seg_map_start[SEG_MAP_SIZE];
+static seg_t seg_map_seg[SEG_MAP_SIZE];
+static unsigned seg_map_len;
+// Cached bounds of instruction and data memory.
+static uint64_t text_start, data_start, kernel_start;
+
+static void seg_map_add(const uint64_t start, const seg_t seg) {
+    unsigned i = seg_map_len++;
+    // Insertion sort. Equal starts keep insertion order, so the later entry wins lookups.
+    for (; i > 0 && seg_map_start[i-1] > start; i--) {
+        seg_map_start[i] = seg_map_start[i-1];
+        seg_map_seg[i] = seg_map_seg[i-1];
+    }
+    seg_map_start[i] = start;
+    seg_map_seg[i] = seg;
+}
+
+void mem_update_segments(void) {
+    uint64_t *starts = guest.mem->seg_start_addr;
+    seg_map_len = 0;
+    seg_map_add(starts[STACK_SEG] > STACK_LIMIT ? starts[STACK_SEG] - STACK_LIMIT : 0, STACK_SEG);
+    for (int i = 0; i <= KERNEL_SEG; i++)
+        seg_map_add(starts[i], i);
+    text_start = starts[TEXT_SEG];
+    data_start = starts[DATA_SEG];
+    kernel_start = starts[KERNEL_SEG];
+    // Cached translations may carry protections from the old map.
+    tlb_flush();
+}
+
+// Index of the last map entry starting at or below addr.
+static unsigned seg_map_find(const uint64_t addr) {
+    unsigned lo = 0, hi = seg_map_len;
+    while (hi - lo > 1) {
+        unsigned mid = (lo + hi) / 2;
+        if (seg_map_start[mid] <= addr)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// Protection bits of a page: the union over every segment it overlaps.
+static uint8_t seg_map_page_prot(const uint64_t pnum) {
+    uint64_t end = (pnum + 1) * PAGESIZE;
+    unsigned i = seg_map_find(pnum * PAGESIZE);
+    uint8_t prot = guest.mem->seg_prot[seg_map_seg[i]];
+    for (i++; i < seg_map_len && seg_map_start[i] < end; i++)
+        prot |= guest.mem->seg_prot[seg_map_seg[i]];
+    return prot;
+}
+
 bool addr_in_imem(const uint64_t addr) {
-    return ((guest.mem->seg_start_addr[TEXT_SEG] <= addr) && 
-            (addr < guest.mem->seg_start_addr[DATA_SEG]));
+    return ((text_start <= addr) && (addr < data_start));
 }
 
 bool addr_in_dmem(const uint64_t addr) {
-    return ((guest.mem->seg_start_addr[DATA_SEG] <= addr) && 
-            (addr < guest.mem->seg_start_addr[KERNEL_SEG]));
+    return ((data_start <= addr) && (addr < kernel_start));
 }
 
 bool is_special_addr(const uint64_t addr) {
@@ -52,32 +124,131 @@ bool is_special_addr(const uint64_t addr) {
 }
 
 static byte_order_t get_byte_order(const uint64_t addr) {
-    if ((guest.mem->seg_start_addr[TEXT_SEG] <= addr) && 
-        (addr < guest.mem->seg_start_addr[DATA_SEG]))
+    if ((text_start <= addr) && (addr < data_start))
         return guest.code_order;
     return guest.data_order;
 }
 
-static uint8_t get_prot_bits(const uint64_t addr) {
-    for (int i = 0; i < KERNEL_SEG; i++) {
-        if ((guest.mem->seg_start_addr[i] <= addr) && 
-            (addr < guest.mem->seg_start_addr[i+1]))
-            return guest.mem->seg_prot[i];
+/*
+ * Protection bits of the page holding addr. Pages that exist carry their
+ * own bits in the PTE, and in the TLB entry once they have been accessed;
+ * the segment map decides for pages not yet touched, and for the flat
+ * backend, which has no PTEs.
+ */
+static inline uint8_t _mem_page_prot(const uint64_t pnum) {
+    if (MEM_PTABLE == mem_backend) {
+        tlb_entry_t *e = tlb_peek(pnum);
+        if (e) return e->t_prot;
+        pte_ptr_t page = get_page(pnum);
+        if (page) return page->p_prot;
     }
-    return guest.mem->seg_prot[KERNEL_SEG];
+    return seg_map_page_prot(pnum);
 }
 
-static uint8_t _mem_read_byte(const uint64_t addr) {
+bool mem_access_ok(const uint64_t addr, const unsigned width, const uint8_t prot) {
+    if ((_mem_page_prot(addr / PAGESIZE) & prot) != prot)
+        return false;
+    uint64_t last = addr + width - 1;
+    if (last / PAGESIZE != addr / PAGESIZE)
+        return (_mem_page_prot(last / PAGESIZE) & prot) == prot;
+    return true;
+}
+
+// Add protection bits to an existing page.
+static void _mem_grant(pte_ptr_t page, const uint8_t prot) {
+    if ((page->p_prot | prot) == page->p_prot) return;
+    page->p_prot |= prot;
+    tlb_invalidate(page->p_num);
+}
+
+/*
+ * Return the host address of the page holding addr, materializing the page
+ * on first touch. The software TLB is checked before the page table.
+ * Untouched pages are read from the shared zero page; a private page is
+ * allocated only on the first write.
+ */
+static char *_mem_page_data(const uint64_t addr, const bool write) {
     uint64_t pnum = addr / PAGESIZE;
-    uint64_t poff = addr % PAGESIZE;
+    if (MEM_FLAT == mem_backend) {
+        char *data = flat_translate(pnum * PAGESIZE);
+        if (data) return data;
+    }
+    tlb_entry_t *e = tlb_lookup(pnum, write);
+    if (e) return e->t_data;
+    pte_ptr_t page = get_page(pnum);
+    if (NULL == page) {
+        if (write)
+            page = add_page(pnum, seg_map_page_prot(pnum));
+        else
+            page = add_zero_page(pnum, seg_map_page_prot(pnum));
+    }
+    if (write) {
+        unshare_page(page);
+        mark_dirty(page);
+    }
+    return tlb_fill(page)->t_data;
+}
+
+char *mem_host_page(const uint64_t pnum, const uint8_t prot) {
+    if (MEM_FLAT == mem_backend) {
+        char *data = flat_translate(pnum * PAGESIZE);
+        if (data) return data;
+    }
+    pte_ptr_t page = get_page(pnum);
+    if (NULL == page)
+        page = add_page(pnum, prot);
+    _mem_grant(page, prot);
+    unshare_page(page);
+    mark_dirty(page);
+    return page->p_data;
+}
+
+void mem_reserve_page(const uint64_t pnum, const uint8_t prot) {
+    if (MEM_FLAT == mem_backend) {
+        volatile char *data = flat_translate(pnum * PAGESIZE);
+        // A read fault maps the host zero page, which makes the page count as touched.
+        if (data) {
+            (void) *data;
+            return;
+        }
+    }
     pte_ptr_t page = get_page(pnum);
     if (NULL == page)
-        page = add_page(pnum, get_prot_bits(addr));
-    return page->p_data[poff];
+        add_zero_page(pnum, prot);
+    else
+        _mem_grant(page, prot);
+}
+
+char *mem_peek_page(const uint64_t pnum) {
+    if (MEM_FLAT == mem_backend) {
+        char *data = flat_translate(pnum * PAGESIZE);
+        if (data) return flat_page_touched(pnum * PAGESIZE) ? data : NULL;
+    }
+    pte_ptr_t page = get_page(pnum);
+    return page ? page->p_data : NULL;
+}
+
+static uint8_t _mem_read_byte(const uint64_t addr) {
+    return _mem_page_data(addr, false)[addr % PAGESIZE];
+}
+
+/*
+ * Accesses that stay inside one page are done with a single page lookup
+ * and memcpy. The byte loops remain for page-crossing accesses, and for
+ * big-endian hosts where the fast paths below would need the opposite swap.
+ */
+static inline bool _mem_in_one_page(const uint64_t addr, const unsigned width) {
+    return (addr % PAGESIZE) + width <= PAGESIZE;
 }
 
 static uint64_t _mem_read_LE(const uint64_t addr, const unsigned width) {
     uint64_t retval = 0ULL;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (_mem_in_one_page(addr, width)) {
+        memcpy(&retval, _mem_page_data(addr, false) + addr % PAGESIZE, width);
+        return retval;
+    }
+#endif
     for (int i = width-1; i >= 0; i--)
         retval = (retval << 8) + _mem_read_byte(addr+i);
     return retval;
@@ -85,6 +256,12 @@ static uint64_t _mem_read_LE(const uint64_t addr, const unsigned width) {
 
 static uint64_t _mem_read_BE(const uint64_t addr, const unsigned width) {
     uint64_t retval = 0ULL;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (_mem_in_one_page(addr, width)) {
+        memcpy(&retval, _mem_page_data(addr, false) + addr % PAGESIZE, width);
+        return __builtin_bswap64(retval) >> (64 - 8*width);
+    }
+#endif
     for (int i = 0; i < width; i++)
         retval = (retval << 8) + _mem_read_byte(addr+i);
     return retval;
@@ -117,19 +294,19 @@ static uint64_t _mem_read_special(const uint64_t addr, const unsigned width) {
 }
 
 static write_ret_code_t _mem_write_byte(const uint64_t addr, const uint8_t data) {
-    uint64_t pnum = addr / PAGESIZE;
-    uint64_t poff = addr % PAGESIZE;
-    pte_ptr_t page = get_page(pnum);
-    if (NULL == page) {
-        page = add_page(pnum, 7);//TODO: FIX.
-    }
-    page->p_data[poff] = data;
+    _mem_page_data(addr, true)[addr % PAGESIZE] = data;
     return WRITE_SUCCESS;
 }
 
 static write_ret_code_t _mem_write_LE(const uint64_t addr, const uint64_t data, const unsigned width) {
     uint8_t *s = (uint8_t *) &data;
     write_ret_code_t retval = WRITE_FAILURE;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (_mem_in_one_page(addr, width)) {
+        memcpy(_mem_page_data(addr, true) + addr % PAGESIZE, s, width);
+        return WRITE_SUCCESS;
+    }
+#endif
     for (int i = 0; i < width; i++)
         retval |= _mem_write_byte(addr+i, s[i]);
     return retval;
@@ -138,6 +315,13 @@ static write_ret_code_t _mem_write_LE(const uint64_t addr, const uint64_t data,
 static write_ret_code_t _mem_write_BE(const uint64_t addr, const uint64_t data, const unsigned width) {
     uint8_t *s = (uint8_t *) &data;
     write_ret_code_t retval = WRITE_FAILURE;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (_mem_in_one_page(addr, width)) {
+        uint64_t swapped = __builtin_bswap64(data) >> (64 - 8*width);
+        memcpy(_mem_page_data(addr, true) + addr % PAGESIZE, &swapped, width);
+        return WRITE_SUCCESS;
+    }
+#endif
     for (int i = 0; i < width; i++)
         retval |= _mem_write_byte(addr+i, s[width-i-1]);
     return retval;
@@ -166,53 +350,160 @@ static write_ret_code_t _mem_write_special(const uint64_t addr, const uint64_t d
     assert(false); return WRITE_SUCCESS;
 }
 
-static uint64_t _mem_read_cache(const uint64_t addr, const unsigned width) {
-    size_t B = guest.cache->B;
-	uword_t current_address = addr;
-    word_t data = 0;
+void mem_read_block(const uint64_t addr, uint8_t *buf, const unsigned len) {
+    memcpy(buf, _mem_page_data(addr, false) + addr % PAGESIZE, len);
+}
 
-    for (size_t i = 0; i < width; i++) {
-        //cache miss code
-        if (!check_hit(guest.cache, current_address, READ)) {
-            uword_t block_address = current_address & ~(B-1);
-            // first cycle of a miss, keep track of address and number of cycles
-            if(inflight_addr != block_address || !inflight) {
-                inflight_addr = block_address;
-                inflight_cycles = guest.cache->d;
-                inflight = true;
-            }
+void mem_write_block(const uint64_t addr, const uint8_t *buf, const unsigned len) {
+    memcpy(_mem_page_data(addr, true) + addr % PAGESIZE, buf, len);
+}
 
-            // decrement cycles to wait and return if > 0
-            inflight_cycles--;
-            if(inflight_cycles > 0) {
-                dmem_status = IN_FLIGHT;
-                return 0;
-            }
+// After a miss: a block in the victim cache swaps in with no miss penalty.
+static bool _mem_victim_hit(const uint64_t addr, const operation_t op) {
+    if (!guest.cache->victim || !victim_hit(guest.cache, addr, op))
+        return false;
+    if (prefetcher.kind)
+        prefetch_filled(cache_find(guest.cache, addr));
+    return true;
+}
 
-            // cache delay is now finished
-            inflight = false;
-            // get data from memory to store in the cache
-            uint8_t *block = calloc(B, 1);
-            for (int j = 0; j < B; j++) {
-                block[j] = _mem_read_LE(addr+j, 1);
-            }
-            // hopefully they properly implemented writing incoming data to the cache
-            evicted_line_t *evicted = handle_miss(guest.cache, block_address, READ, block);
-            data = *((uint64_t *)block + (addr & (B-1)));
-            // if the evicted line is valid and dirty, write changes back to memory
-            if (evicted->valid && evicted->dirty) {
-                for (int j = 0; j < B; j++) {
-                    _mem_write_LE(evicted->addr+j, evicted->data[j], 1);
-                }
+/*
+ * Whether the block holding addr is in the L1 data cache, counting one hit
+ * or miss per access. A miss takes the latency of the level that holds the
+ * block; until it has passed, dmem_status is IN_FLIGHT and the pipeline
+ * retries the access. The block is brought in on the last cycle.
+ */
+static bool _mem_cache_block_ready(const uint64_t addr, const operation_t op) {
+    uword_t block_address = addr & ~(uword_t) (guest.cache->B - 1);
+    if (!inflight || inflight_addr != block_address) {
+        bool hit = check_hit(guest.cache, addr, op);
+        if (prefetcher.kind)
+            prefetch_access(addr, hit);
+        if (hit || _mem_victim_hit(addr, op))
+            return true;
+        // A prefetch already on its way only has its remaining cycles left.
+        uint64_t ready;
+        inflight_addr = block_address;
+        inflight_cycles = prefetch_claim(block_address, &ready) ? ready - num_instr + 1
+                                                                 : hierarchy_miss_latency(block_address);
+        inflight = true;
+    }
+    if (inflight_cycles > 1) {
+        inflight_cycles--;
+        dmem_status = IN_FLIGHT;
+        return false;
+    }
+    inflight = false;
+    hierarchy_fill(block_address, op);
+    return true;
+}
+
+/*
+ * The same for an instruction fetch from the L1 instruction cache, with
+ * imem_status in place of dmem_status. The fetch stage retries the same PC
+ * until the block is in.
+ */
+bool mem_fetch_ready(const uint64_t addr) {
+    uword_t block_address = addr & ~(uword_t) (guest.icache->B - 1);
+    if (!imem_inflight || imem_inflight_addr != block_address) {
+        long line = cache_find(guest.icache, addr);
+        if (line >= 0) {
+            hierarchy.icache.hits++;
+            cache_touch(guest.icache, addr, line);
+            return true;
+        }
+        hierarchy.icache.misses++;
+        imem_inflight_addr = block_address;
+        imem_inflight_cycles = hierarchy_miss_latency(block_address);
+        imem_inflight = true;
+    }
+    if (imem_inflight_cycles > 1) {
+        imem_inflight_cycles--;
+        imem_status = IN_FLIGHT;
+        return false;
+    }
+    imem_inflight = false;
+    hierarchy_fill_icache(block_address);
+    return true;
+}
+
+/*
+ * Park the memory stage on a block; it retries the access next cycle. full
+ * says it waits for a free MSHR rather than for the block. inflight_cycles,
+ * the blocking path's countdown, has no other use with -M, so it keeps that.
+ */
+static bool _mem_mshr_wait(const uword_t block_address, const bool full) {
+    inflight = true;
+    inflight_addr = block_address;
+    inflight_cycles = full;
+    dmem_status = IN_FLIGHT;
+    return false;
+}
+
+/*
+ * Non-blocking form of _mem_cache_block_ready(), used with -M. A miss takes
+ * an MSHR, or merges into the one already fetching its block. A store that
+ * misses leaves its data in the MSHR and is done; a load waits for its own
+ * block only, so accesses that hit go ahead of outstanding misses. Returns
+ * false while the access must wait. A write is complete once this returns
+ * true.
+ */
+static bool _mem_mshr_access(const uint64_t addr, const operation_t op, const uint64_t data) {
+    uword_t block_address = addr & ~(uword_t) (guest.cache->B - 1);
+    bool retry = inflight && inflight_addr == block_address;
+    mshr_t *m = mshr_find(block_address);
+    long line = -1;
+    // The miss was counted on the first try. If the block has come in and
+    // another fill to its set in the same cycle pushed it out again, this
+    // is a fresh access.
+    if (retry && !m) {
+        if ((line = cache_find(guest.cache, addr)) >= 0)
+            cache_touch(guest.cache, addr, line);
+        else if (!inflight_cycles)
+            retry = false;
+    }
+    inflight = false;
+    if (!retry && m) {
+        miss_count++;
+        mshrs.merged++;
+    }
+    else if (!retry) {
+        operation_t cache_op = hierarchy.write_through ? READ : op;
+        bool hit = check_hit(guest.cache, addr, cache_op);
+        if (prefetcher.kind)
+            prefetch_access(addr, hit);
+        if (hit || _mem_victim_hit(addr, cache_op))
+            line = cache_find(guest.cache, addr);
+    }
+
+    if (line < 0) {
+        if (!m) {
+            if (!(m = mshr_alloc(block_address, 0))) {
+                mshrs.full_stalls++;
+                return _mem_mshr_wait(block_address, true);
             }
-            // free temps
-            free(block);
-            free(evicted->data);
-            free(evicted);
+            if (!prefetch_claim(block_address, &m->ready))
+                m->ready = num_instr + hierarchy_miss_latency(block_address) - 1;
         }
-        current_address++;
+        if (WRITE == op && mshr_add_store(m, addr, data))
+            return true;
+        if (m->ready > num_instr)
+            return _mem_mshr_wait(block_address, false);
+        mshr_complete(m);
+        line = cache_find(guest.cache, addr);
+    }
+    if (WRITE == op) {
+        if (!hierarchy.write_through)
+            guest.cache->dirty[line] = 1;
+        set_word_cache(guest.cache, addr, data);
     }
-    // actually get data from the cache
+    return true;
+}
+
+static uint64_t _mem_read_cache(const uint64_t addr, const unsigned width) {
+    word_t data = 0;
+    if (mshrs.num ? !_mem_mshr_access(addr, READ, 0) : !_mem_cache_block_ready(addr, READ))
+        return 0;
     get_word_cache(guest.cache, addr, &data);
     dmem_status = READY;
     return data;
@@ -221,9 +512,11 @@ static uint64_t _mem_read_cache(const uint64_t addr, const unsigned width) {
 uint64_t _mem_read(const uint64_t addr, const unsigned width) {
     if (is_special_addr(addr))
         return _mem_read_special(addr, width);
+    if (!mem_access_ok(addr, width, MEM_PROT_R))
+        return 0;
 
     // Use the cache if it exists and this is not an instruction.
-    if (guest.cache && addr >= seg_starts[DATA_SEG]) {
+    if (guest.cache && addr >= data_start) {
         return _mem_read_cache(addr, width);
     }
 
@@ -238,46 +531,49 @@ uint64_t _mem_read(const uint64_t addr, const unsigned width) {
     }
 }
 
+/*
+ * A store goes below the L1 data cache with -W through, and on a miss with
+ * -N, in which case it writes around the cache: *around is set. On its
+ * first try such a store waits, with nothing counted, while the write
+ * buffer has no room for it. Returns false while it must wait.
+ */
+static bool _mem_store_ready(const uint64_t addr, bool *around) {
+    uword_t block_address = addr & ~(uword_t) (guest.cache->B - 1);
+    *around = false;
+    if (!hierarchy.wbuf.depth || (inflight && inflight_addr == block_address))
+        return true;
+    bool miss = cache_find(guest.cache, addr) < 0 && !(guest.cache->victim && victim_find(guest.cache, addr) >= 0);
+    if (!hierarchy.write_through && (!miss || hierarchy.write_allocate))
+        return true;
+    if (!write_buffer_room(block_address)) {
+        hierarchy.wbuf.full_stalls++;
+        dmem_status = IN_FLIGHT;
+        return false;
+    }
+    *around = miss && !hierarchy.write_allocate;
+    return true;
+}
+
 static write_ret_code_t _mem_write_cache(const uint64_t addr, const uint64_t data, const unsigned width) {
-    size_t B = guest.cache->B;
-	uword_t current_address = addr; 
-
-    for (size_t i = 0; i < width; i++) {
-        // cache miss code
-        if (!check_hit(guest.cache, current_address, WRITE)) {
-            // first miss cycle, keep track of addr and number of cycles to wait
-            uword_t block_address = current_address & ~(B-1);
-            if(inflight_addr != block_address || !inflight) {
-                inflight_addr = block_address;
-                inflight_cycles = guest.cache->d;
-                inflight = true;
-            }
-            // wait a cycle until delay is done
-            inflight_cycles--;
-            if(inflight_cycles > 0) {
-                dmem_status = IN_FLIGHT;
-                return WRITE_FAILURE;
-            }
-            // no more delay
-            inflight = false;
-            // get evicted line from cache,
-            // incoming data is NULL here because the students are supposed
-            // to implement the write themselves.
-            evicted_line_t *evicted = handle_miss(guest.cache, block_address, WRITE, NULL);
-            // if evicted line is dirty, write changes back to memory
-            if (evicted->valid && evicted->dirty) {
-                for (int j = 0; j < B; j++) {
-                    _mem_write_LE(evicted->addr+j, evicted->data[j], 1);
-                }
-            }
-            // free temps
-            free(evicted->data);
-            free(evicted);
-        }
-        current_address++;
+    bool around;
+    if (!_mem_store_ready(addr, &around))
+        return WRITE_FAILURE;
+    if (around) {
+        check_hit(guest.cache, addr, WRITE);
+        if (prefetcher.kind)
+            prefetch_access(addr, false);
+    }
+    else if (mshrs.num) {
+        if (!_mem_mshr_access(addr, WRITE, data))
+            return WRITE_FAILURE;
+    }
+    else {
+        if (!_mem_cache_block_ready(addr, hierarchy.write_through ? READ : WRITE))
+            return WRITE_FAILURE;
+        set_word_cache(guest.cache, addr, data);
     }
-    // actually write to the cache.
-    set_word_cache(guest.cache, addr, data);
+    if (around || hierarchy.write_through)
+        hierarchy_store(addr, data);
     dmem_status = READY;
     return WRITE_SUCCESS;
 }
@@ -285,9 +581,11 @@ static write_ret_code_t _mem_write_cache(const uint64_t addr, const uint64_t dat
 write_ret_code_t _mem_write(const uint64_t addr, const uint64_t data, const unsigned width) {
     if (is_special_addr(addr))
         return _mem_write_special(addr, data, width);
+    if (!mem_access_ok(addr, width, MEM_PROT_W))
+        return WRITE_FAILURE;
 
     // Use the cache if it exists and this is not an instruction.
-    if (guest.cache && addr >= seg_starts[TEXT_SEG] + 0x10000) {//seg_starts[DATA_SEG]) { hack for now
+    if (guest.cache && addr >= data_start) {
         return _mem_write_cache(addr, data, width);
     }
 
@@ -0,0 +1,127 @@
+/**************************************************************************
+ * C S 429 system emulator
+ *
+ * mshr.c - Module for the miss status holding registers of the L1 data
+ * cache.
+ *
+ * The memory stage allocates entries and merges into them (see mem.c);
+ * this module keeps the entries, completes them as their blocks arrive,
+ * and counts how many misses are outstanding on each cycle.
+ *
+ * Copyright (c) 2023.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/
+
+#include <string.h>
+#include "archsim.h"
+#include "hierarchy.h"
+#include "mshr.h"
+
+extern machine_t guest;
+
+mshr_file_t mshrs;
+
+void init_mshrs(int n) {
+    memset(&mshrs, 0, sizeof(mshrs));
+    mshrs.num = n;
+}
+
+mshr_t *mshr_find(uint64_t block) {
+    for (int i = 0; i < mshrs.num; i++) {
+        if (mshrs.entries[i].valid && mshrs.entries[i].block == block)
+            return &mshrs.entries[i];
+    }
+    return NULL;
+}
+
+mshr_t *mshr_alloc(uint64_t block, uint64_t ready) {
+    for (int i = 0; i < mshrs.num; i++) {
+        mshr_t *m = &mshrs.entries[i];
+        if (!m->valid) {
+            m->valid = true;
+            m->block = block;
+            m->ready = ready;
+            m->num_stores = 0;
+            return m;
+        }
+    }
+    return NULL;
+}
+
+bool mshr_add_store(mshr_t *m, uint64_t addr, uint64_t data) {
+    if (m->num_stores == MSHR_STORES)
+        return false;
+    m->stores[m->num_stores].addr = addr;
+    m->stores[m->num_stores].data = data;
+    m->num_stores++;
+    return true;
+}
+
+void mshr_complete(mshr_t *m) {
+    hierarchy_fill(m->block, m->num_stores && !hierarchy.write_through ? WRITE : READ);
+    for (int i = 0; i < m->num_stores; i++)
+        set_word_cache(guest.cache, m->stores[i].addr, m->stores[i].data);
+    m->valid = false;
+}
+
+// The outstanding entry whose block arrives first, if it is due by now.
+static mshr_t *next_due(uint64_t now) {
+    mshr_t *due = NULL;
+    for (int i = 0; i < mshrs.num; i++) {
+        mshr_t *m = &mshrs.entries[i];
+        if (m->valid && m->ready <= now && (!due || m->ready < due->ready))
+            due = m;
+    }
+    return due;
+}
+
+void mshr_tick(uint64_t now) {
+    if (!mshrs.num)
+        return;
+    mshr_t *m;
+    while ((m = next_due(now)))
+        mshr_complete(m);
+    int outstanding = 0;
+    for (int i = 0; i < mshrs.num; i++)
+        outstanding += mshrs.entries[i].valid;
+    mshrs.mlp_hist[outstanding]++;
+}
+
+void mshr_drain(void) {
+    mshr_t *m;
+    while ((m = next_due(UINT64_MAX)))
+        mshr_complete(m);
+}
+
+// A store lands in its block byte by byte, as set_word_cache() puts it.
+void mshr_write_back(void) {
+    for (int i = 0; i < mshrs.num; i++) {
+        mshr_t *m = &mshrs.entries[i];
+        for (int s = 0; m->valid && s < m->num_stores; s++) {
+            for (int j = 0; j < 8; j++) {
+                uint8_t byte = m->stores[s].data >> (8*j);
+                mem_write_block(m->block + ((m->stores[s].addr + j) & guest.cache->off_mask), &byte, 1);
+            }
+        }
+    }
+}
+
+void log_mshr_stats(FILE *out) {
+    uint64_t cycles = 0, busy = 0, weighted = 0;
+    for (int i = 0; i <= mshrs.num; i++) {
+        cycles += mshrs.mlp_hist[i];
+        if (i) {
+            busy += mshrs.mlp_hist[i];
+            weighted += i * mshrs.mlp_hist[i];
+        }
+    }
+    fprintf(out, "\tMSHRs: %d, merged misses %lu, cycles waiting for a free MSHR %lu\n",
+            mshrs.num, mshrs.merged, mshrs.full_stalls);
+    fprintf(out, "\tCycles with n misses outstanding:");
+    for (int i = 0; i <= mshrs.num; i++)
+        fprintf(out, " %d: %lu (%.1f%%)%s", i, mshrs.mlp_hist[i],
+                cycles ? 100.0 * mshrs.mlp_hist[i] / cycles : 0.0, i < mshrs.num ? "," : "\n");
+    fprintf(out, "\tMLP (average over cycles with a miss outstanding): %.2f\n",
+            busy ? (double) weighted / busy : 0.0);
+}
@@ -0,0 +1,202 @@
+/**************************************************************************
+ * C S 429 system emulator
+ *
+ * prefetch.c - Module for the hardware prefetchers of the L1 data cache.
+ *
+ * Prefetchers train on triggers: demand misses, and first hits on
+ * prefetched lines, so that a prefetcher that is keeping up still sees
+ * the stream it is covering. They work in block numbers; a prefetch is
+ * dropped if its block is outside the data segments, already in the
+ * cache, or already on its way.
+ *
+ * Copyright (c) 2023.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "archsim.h"
+#include "hierarchy.h"
+#include "mshr.h"
+#include "prefetch.h"
+
+extern machine_t guest;
+extern uint64_t num_instr;
+extern int miss_count;
+
+prefetcher_t prefetcher;
+
+static bool *unused_lines;      // Per L1 data cache line: prefetched, not yet used
+
+static const char *names[] = {"none", "next", "stride", "stream"};
+
+int parse_prefetcher(const char *name) {
+    for (int i = 0; i < (int) (sizeof(names) / sizeof(names[0])); i++) {
+        if (!strcmp(name, names[i]))
+            return i;
+    }
+    return -1;
+}
+
+const char *prefetcher_name(prefetcher_kind_t kind) {
+    return names[kind];
+}
+
+void init_prefetcher(prefetcher_kind_t kind, unsigned num_lines) {
+    memset(&prefetcher, 0, sizeof(prefetcher));
+    prefetcher.kind = kind;
+    free(unused_lines);
+    unused_lines = kind ? calloc(num_lines, sizeof(bool)) : NULL;
+}
+
+// Whether a prefetch for this block is in flight.
+static prefetch_req_t *pending(uint64_t block_addr) {
+    for (int i = 0; i < PREFETCH_QUEUE; i++) {
+        if (prefetcher.queue[i].valid && prefetcher.queue[i].block == block_addr)
+            return &prefetcher.queue[i];
+    }
+    return NULL;
+}
+
+static void issue(uint64_t block) {
+    cache_t *cache = guest.cache;
+    uint64_t addr = block << cache->b_bits;
+    if (!addr_in_dmem(addr) || !mem_access_ok(addr, cache->B, MEM_PROT_R))
+        return;
+    if (cache_find(cache, addr) >= 0 || (cache->victim && victim_find(cache, addr) >= 0) ||
+        mshr_find(addr) || pending(addr))
+        return;
+    for (int i = 0; i < PREFETCH_QUEUE; i++) {
+        prefetch_req_t *req = &prefetcher.queue[i];
+        if (!req->valid) {
+            req->valid = true;
+            req->block = addr;
+            req->ready = num_instr + hierarchy_miss_latency(addr) - 1;
+            prefetcher.issued++;
+            return;
+        }
+    }
+    prefetcher.dropped++;
+}
+
+// Keep a stream STREAM_DEPTH blocks ahead of the block just used.
+static void run_stream(stream_t *s, uint64_t block) {
+    s->last_use = ++prefetcher.clock;
+    while ((int64_t) (s->next - block) * s->dir <= STREAM_DEPTH) {
+        issue(s->next);
+        s->next += s->dir;
+    }
+}
+
+static void train_streams(uint64_t block, bool miss) {
+    stream_t *victim = &prefetcher.streams[0];
+    for (int i = 0; i < NUM_STREAMS; i++) {
+        stream_t *s = &prefetcher.streams[i];
+        int64_t ahead = (int64_t) (s->next - block) * s->dir;
+        if (s->valid && ahead > 0 && ahead <= STREAM_DEPTH + 1) {
+            run_stream(s, block);
+            return;
+        }
+        if (!s->valid || (victim->valid && s->last_use < victim->last_use))
+            victim = s;
+    }
+    // Only a miss outside every stream starts a new one, running away
+    // from the previous trigger if that was the block just after.
+    if (!miss)
+        return;
+    victim->valid = true;
+    victim->dir = block + 1 == prefetcher.last_block ? -1 : 1;
+    victim->next = block + victim->dir;
+    run_stream(victim, block);
+}
+
+static void train(uint64_t block, bool miss) {
+    int64_t stride = block - prefetcher.last_block;
+    switch (prefetcher.kind) {
+        case PF_NEXT_LINE:
+            issue(block + 1);
+            break;
+        case PF_STRIDE:
+            // The same distance twice in a row.
+            if (stride && stride == prefetcher.last_stride) {
+                for (int k = 1; k <= STRIDE_DEGREE; k++)
+                    issue(block + k * stride);
+            }
+            break;
+        case PF_STREAM:
+            train_streams(block, miss);
+            break;
+        default:
+            break;
+    }
+    prefetcher.last_stride = stride;
+    prefetcher.last_block = block;
+}
+
+void prefetch_access(uint64_t addr, bool hit) {
+    if (hit) {
+        long line = cache_find(guest.cache, addr);
+        if (!unused_lines[line])
+            return;
+        unused_lines[line] = false;
+        prefetcher.useful++;
+    }
+    train(addr >> guest.cache->b_bits, !hit);
+}
+
+bool prefetch_claim(uint64_t block_addr, uint64_t *ready) {
+    prefetch_req_t *req = pending(block_addr);
+    if (!req)
+        return false;
+    *ready = req->ready;
+    req->valid = false;
+    prefetcher.useful++;
+    prefetcher.late++;
+    return true;
+}
+
+void prefetch_filled(long line) {
+    if (unused_lines[line])
+        prefetcher.unused++;
+    unused_lines[line] = false;
+}
+
+bool prefetch_line_unused(long line) {
+    return unused_lines && unused_lines[line];
+}
+
+void prefetch_set_line_unused(long line, bool unused) {
+    if (unused_lines)
+        unused_lines[line] = unused;
+}
+
+void prefetch_tick(uint64_t now) {
+    if (!prefetcher.kind)
+        return;
+    for (;;) {
+        prefetch_req_t *due = NULL;
+        for (int i = 0; i < PREFETCH_QUEUE; i++) {
+            prefetch_req_t *req = &prefetcher.queue[i];
+            if (req->valid && req->ready <= now && (!due || req->ready < due->ready))
+                due = req;
+        }
+        if (!due)
+            return;
+        due->valid = false;
+        hierarchy_fill(due->block, READ);
+        unused_lines[cache_find(guest.cache, due->block)] = true;
+    }
+}
+
+void log_prefetch_stats(FILE *out) {
+    uint64_t p = prefetcher.useful;
+    uint64_t would_miss = miss_count - prefetcher.late + p;
+    fprintf(out, "\tPrefetcher %s: issued %lu, dropped %lu, useful %lu (late %lu), evicted unused %lu\n",
+            prefetcher_name(prefetcher.kind), prefetcher.issued, prefetcher.dropped, p, prefetcher.late,
+            prefetcher.unused);
+    fprintf(out, "\tPrefetch accuracy %.1f%%, coverage %.1f%%, timeliness %.1f%%\n",
+            prefetcher.issued ? 100.0 * p / prefetcher.issued : 0.0,
+            would_miss ? 100.0 * p / would_miss : 0.0,
+            p ? 100.0 * (p - prefetcher.late) / p : 0.0);
+}
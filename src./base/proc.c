@@ -14,6 +14,8 @@
 #include "archsim.h"
 #include "hw_elts.h"
 #include "hazard_control.h"
+#include "mshr.h"
+#include "prefetch.h"
 
 extern uint32_t bitfield_u32(int32_t src, unsigned frompos, unsigned width);
 extern int64_t bitfield_s64(int32_t src, unsigned frompos, unsigned width);
@@ -30,6 +32,22 @@ int runElf(const uint64_t entry) {
     guest.proc->NZCV.bits->ccval = PACK_CC(0, 1, 0, 0);
     guest.proc->GPR.bits[30].xval = RET_FROM_MAIN_ADDR;
 
+    init_pipeline();
+
+    /* Will be selected as the first PC */
+    F_out->pred_PC = guest.proc->PC.bits->xval;
+    F_out->status = STAT_AOK;
+    dmem_status = READY;
+
+#ifdef DEBUG
+    printf("\n%s%s   Addr      Instr       Op  \tCond\tDest\tSrc1\tSrc2\tImmval   \t\tShift%s\n", 
+           ANSI_BOLD, ANSI_COLOR_RED, ANSI_RESET);
+#endif
+    num_instr = 0;
+    return run_pipeline();
+}
+
+void init_pipeline(void) {
     pipe_reg_t **pipes[] = {&F_instr, &D_instr, &X_instr, &M_instr, &W_instr};
 
     uint64_t sizes[5] = {sizeof(f_instr_impl_t), sizeof(d_instr_impl_t), sizeof(x_instr_impl_t),
@@ -41,18 +59,17 @@ int runElf(const uint64_t entry) {
         (*pipes[i])->out = (pipe_reg_implt_t) calloc(1, sizes[i]);
         (*pipes[i])->ctl = P_BUBBLE;
     }
+}
 
-    /* Will be selected as the first PC */
-    F_out->pred_PC = guest.proc->PC.bits->xval;
-    F_out->status = STAT_AOK;
-    dmem_status = READY;
+int run_pipeline(void) {
+    pipe_reg_t **pipes[] = {&F_instr, &D_instr, &X_instr, &M_instr, &W_instr};
 
-#ifdef DEBUG
-    printf("\n%s%s   Addr      Instr       Op  \tCond\tDest\tSrc1\tSrc2\tImmval   \t\tShift%s\n", 
-           ANSI_BOLD, ANSI_COLOR_RED, ANSI_RESET);
-#endif
-    num_instr = 0;
     do {        
+        /* Blocks that arrive this cycle are in the cache before any stage looks */
+        mshr_tick(num_instr);
+        prefetch_tick(num_instr);
+        write_buffer_tick(num_instr);
+
         /* Run each stage (in reverse order, to get the correct effect) */
         /* TODO: rewrite as independent threads */
         wback_instr(W_out);
@@ -104,7 +121,16 @@ int runElf(const uint64_t entry) {
         }
 
         num_instr++;
+
+        if (checkpoint_interval && num_instr % checkpoint_interval == 0)
+            log_machine_state();
     } while ((guest.proc->status == STAT_AOK || guest.proc->status == STAT_BUB)
              && num_instr < cycle_max);
+
+    /* A machine that has halted lets its outstanding misses and stores finish */
+    if (guest.proc->status != STAT_AOK && guest.proc->status != STAT_BUB) {
+        mshr_drain();
+        write_buffer_drain();
+    }
     return EXIT_SUCCESS;
 }
\ No newline at end of file
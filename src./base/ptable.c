@@ -8,6 +8,23 @@
  * This is not a real paged virtual memory. It is just a way to provide the
  * illusion of a 64-bit address page and materialize pages on first touch.
  * In particular, there is no page replacement.
+ * 
+ * The page table is a four-level radix tree laid out like the AArch64
+ * 4 KiB translation granule: a 48-bit address is split into four 9-bit
+ * table indices and a 12-bit page offset, so every lookup costs exactly
+ * four loads no matter how many pages exist. Page numbers that do not fit
+ * in 36 bits (addresses above 2^48) are rare and live in a small chained
+ * hash table instead.
+ * 
+ * Pages that are read before they are written share a single read-only
+ * zero page and only get their own payload on the first write.
+ * 
+ * Every page created or written since the last checkpoint is dirty and sits
+ * on a list, so incremental checkpoints touch only those pages.
+ * 
+ * Page payloads and radix tree nodes are carved out of 2 MiB host chunks,
+ * and PTEs out of pooled blocks, instead of one malloc() each. Nothing is
+ * freed individually; free_ptable() releases everything at teardown.
  *  
  * Copyright (c) 2022. 
  * Authors: S. Chatterjee. 
@@ -16,10 +33,101 @@
  **************************************************************************/ 
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
 #include "ptable.h"
+#include "tlb.h"
+
+#define PT_LEVELS 4
+#define PT_BITS 9
+#define PT_ENTRIES (1 << PT_BITS)
+#define PT_PNUM_BITS (PT_LEVELS * PT_BITS)
+
+// An interior node of the radix tree. Slots at the last level hold PTEs.
+typedef struct pt_node {
+    void *slots[PT_ENTRIES];
+} pt_node_t;
+
+static pt_node_t ptable_root;
 
 #define HASHSIZE 128
-static pte_ptr_t ptable[HASHSIZE];
+static pte_ptr_t ptable_overflow[HASHSIZE];
+
+static const char zero_page[PAGESIZE] __attribute__((aligned(PAGESIZE)));
+uint64_t zero_pages;
+uint64_t cow_copies;
+
+#define PTE_POOL_BLOCK 4096
+
+// Chunks and PTE blocks handed out so far, kept for bulk release.
+static void **arena_chunks;
+static uint64_t arena_chunks_cap;
+static char *arena_next;        // Next free frame in the current chunk
+static char *arena_end;         // End of the current chunk
+static void **pte_blocks;
+static uint64_t pte_blocks_cap;
+static pte_ptr_t pte_next;      // Next free PTE in the current block
+static pte_ptr_t pte_end;       // End of the current block
+
+arena_stats_t arena_stats;
+
+// Dirty pages, in the order they became dirty.
+static pte_ptr_t *dirty_list;
+static uint64_t dirty_cap;
+static uint64_t dirty_count;
+
+// Append p as the n-th element of a growable list of allocations.
+static void **track(void **list, uint64_t *cap, const uint64_t n, void *p) {
+    if (n == *cap) {
+        *cap = *cap ? 2 * *cap : 64;
+        list = realloc(list, *cap * sizeof(void *));
+    }
+    list[n] = p;
+    return list;
+}
+
+/*
+ * Map a 2 MiB-aligned chunk, so that the host can back it with a huge page.
+ * Fresh anonymous memory is zero-filled, so frames need no clearing.
+ */
+static void arena_grow(void) {
+    char *raw = mmap(NULL, 2 * ARENA_CHUNK_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (MAP_FAILED == raw) {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+    char *chunk = (char *) (((uintptr_t) raw + ARENA_CHUNK_SIZE - 1) & ~(ARENA_CHUNK_SIZE - 1));
+    if (chunk > raw)
+        munmap(raw, chunk - raw);
+    munmap(chunk + ARENA_CHUNK_SIZE, raw + ARENA_CHUNK_SIZE - chunk);
+#ifdef MADV_HUGEPAGE
+    madvise(chunk, ARENA_CHUNK_SIZE, MADV_HUGEPAGE);
+#endif
+    arena_chunks = track(arena_chunks, &arena_chunks_cap, arena_stats.chunks++, chunk);
+    arena_next = chunk;
+    arena_end = chunk + ARENA_CHUNK_SIZE;
+}
+
+// Hand out a zero-filled, page-aligned frame.
+static void *frame_alloc(void) {
+    if (arena_next == arena_end)
+        arena_grow();
+    void *frame = arena_next;
+    arena_next += PAGESIZE;
+    return frame;
+}
+
+static pte_ptr_t pte_alloc(void) {
+    if (pte_next == pte_end) {
+        pte_next = malloc(PTE_POOL_BLOCK * sizeof(pte_t));
+        pte_end = pte_next + PTE_POOL_BLOCK;
+        pte_blocks = track(pte_blocks, &pte_blocks_cap, arena_stats.pte_blocks++, pte_next);
+    }
+    arena_stats.ptes++;
+    return pte_next++;
+}
 
 static unsigned long ptable_hash(const uint64_t pnum) {
     unsigned long h = 0, high;
@@ -34,22 +142,145 @@ static unsigned long ptable_hash(const uint64_t pnum) {
     return h % HASHSIZE;
 }
 
+static inline unsigned pt_index(const uint64_t pnum, const int level) {
+    return (pnum >> ((PT_LEVELS - 1 - level) * PT_BITS)) & (PT_ENTRIES - 1);
+}
+
+static inline bool pt_in_range(const uint64_t pnum) {
+    return (pnum >> PT_PNUM_BITS) == 0;
+}
+
 pte_ptr_t get_page(const uint64_t pnum) {
-    unsigned long phash = ptable_hash(pnum);
-    pte_ptr_t p = ptable[phash];
-    for (; p != NULL; p = p->p_next) {
-        if (pnum == p->p_num) return p;
+    if (!pt_in_range(pnum)) {
+        pte_ptr_t p = ptable_overflow[ptable_hash(pnum)];
+        for (; p != NULL; p = p->p_next) {
+            if (pnum == p->p_num) return p;
+        }
+        return p;
+    }
+    pt_node_t *node = &ptable_root;
+    for (int level = 0; level < PT_LEVELS - 1; level++) {
+        node = node->slots[pt_index(pnum, level)];
+        if (NULL == node) return NULL;
     }
-    return p;
+    return node->slots[pt_index(pnum, PT_LEVELS - 1)];
 }
 
-pte_ptr_t add_page(const uint64_t num, const uint8_t prot) {
-    pte_ptr_t npage = malloc(sizeof(pte_t));
+void mark_dirty(pte_ptr_t page) {
+    if (page->p_dirty) return;
+    page->p_dirty = true;
+    dirty_list = (pte_ptr_t *) track((void **) dirty_list, &dirty_cap, dirty_count++, page);
+}
+
+pte_ptr_t *dirty_pages(uint64_t *n) {
+    *n = dirty_count;
+    return dirty_list;
+}
+
+void clean_pages(void) {
+    for (uint64_t i = 0; i < dirty_count; i++)
+        dirty_list[i]->p_dirty = false;
+    dirty_count = 0;
+    // TLB entries of dirty pages accept writes; the next write must come back here.
+    tlb_flush();
+}
+
+static pte_ptr_t insert_page(const uint64_t num, const uint8_t prot, char *data, const bool cow) {
+    pte_ptr_t npage = pte_alloc();
     npage->p_num = num;
     npage->p_prot = prot;
-    npage->p_data = calloc(PAGESIZE,sizeof(char));
-    unsigned long phash = ptable_hash(num);
-    npage->p_next = ptable[phash];
-    ptable[phash] = npage;
+    npage->p_cow = cow;
+    npage->p_dirty = false;
+    npage->p_data = data;
+    npage->p_next = NULL;
+    tlb_invalidate(num);
+    mark_dirty(npage);
+    if (!pt_in_range(num)) {
+        unsigned long phash = ptable_hash(num);
+        npage->p_next = ptable_overflow[phash];
+        ptable_overflow[phash] = npage;
+        return npage;
+    }
+    pt_node_t *node = &ptable_root;
+    for (int level = 0; level < PT_LEVELS - 1; level++) {
+        void **slot = &node->slots[pt_index(num, level)];
+        if (NULL == *slot) {
+            *slot = frame_alloc();
+            arena_stats.nodes++;
+        }
+        node = *slot;
+    }
+    node->slots[pt_index(num, PT_LEVELS - 1)] = npage;
     return npage;
-}
\ No newline at end of file
+}
+
+pte_ptr_t add_page(const uint64_t num, const uint8_t prot) {
+    arena_stats.frames++;
+    return insert_page(num, prot, frame_alloc(), false);
+}
+
+pte_ptr_t add_cow_page(const uint64_t num, const uint8_t prot, const char *data) {
+    if (data == zero_page)
+        zero_pages++;
+    return insert_page(num, prot, (char *) data, true);
+}
+
+pte_ptr_t add_zero_page(const uint64_t num, const uint8_t prot) {
+    return add_cow_page(num, prot, zero_page);
+}
+
+void unshare_page(pte_ptr_t page) {
+    if (!page->p_cow) return;
+    char *data = frame_alloc();
+    arena_stats.frames++;
+    memcpy(data, page->p_data, PAGESIZE);
+    if (page->p_data == zero_page)
+        zero_pages--;
+    page->p_data = data;
+    page->p_cow = false;
+    cow_copies++;
+    tlb_invalidate(page->p_num);
+}
+
+bool page_is_zero(const pte_ptr_t page) {
+    return page->p_data == zero_page;
+}
+
+static void walk_node(pt_node_t *node, const int level, void (*visit)(pte_ptr_t, void *), void *arg) {
+    for (int i = 0; i < PT_ENTRIES; i++) {
+        if (NULL == node->slots[i]) continue;
+        if (level == PT_LEVELS - 1)
+            visit(node->slots[i], arg);
+        else
+            walk_node(node->slots[i], level + 1, visit, arg);
+    }
+}
+
+void walk_ptable(void (*visit)(pte_ptr_t, void *), void *arg) {
+    walk_node(&ptable_root, 0, visit, arg);
+    for (int i = 0; i < HASHSIZE; i++) {
+        for (pte_ptr_t p = ptable_overflow[i]; p != NULL; p = p->p_next)
+            visit(p, arg);
+    }
+}
+
+void free_ptable(void) {
+    for (uint64_t i = 0; i < arena_stats.chunks; i++)
+        munmap(arena_chunks[i], ARENA_CHUNK_SIZE);
+    for (uint64_t i = 0; i < arena_stats.pte_blocks; i++)
+        free(pte_blocks[i]);
+    free(arena_chunks);
+    free(pte_blocks);
+    free(dirty_list);
+    arena_chunks = NULL;
+    pte_blocks = NULL;
+    dirty_list = NULL;
+    arena_chunks_cap = pte_blocks_cap = dirty_cap = dirty_count = 0;
+    arena_next = arena_end = NULL;
+    pte_next = pte_end = NULL;
+    memset(&ptable_root, 0, sizeof(ptable_root));
+    memset(ptable_overflow, 0, sizeof(ptable_overflow));
+    memset(&arena_stats, 0, sizeof(arena_stats));
+    zero_pages = cow_copies = 0;
+    tlb_flush();
+}
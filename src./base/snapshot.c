@@ -0,0 +1,484 @@
+/**************************************************************************
+ * C S 429 system emulator
+ * 
+ * snapshot.c - Module for saving and restoring whole-emulator snapshots.
+ * 
+ * File layout:
+ *   snapshot_header_t      registers, pipeline, globals, section offsets
+ *   for each cache level, starting with the first:
+ *     snapshot_line_t[S*A]   cache line metadata
+ *     byte_t[S*A*B]          cache line data
+ *     uword_t[S*REPL_WORDS]  replacement state of each set
+ *   snapshot_page_t[n]     page numbers and protections
+ *   (padding)              up to a page boundary
+ *   pages                  one PAGESIZE payload per page not backed by
+ *                          the shared zero page, in the order above
+ * 
+ * Restore maps the file and points each page at its payload in the
+ * mapping, copy-on-write, so its cost does not depend on page contents.
+ * The mapping is never unmapped, so those pages stay valid.
+ * 
+ * Copyright (c) 2023.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/ 
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "archsim.h"
+#include "ptable.h"
+#include "tlb.h"
+#include "snapshot.h"
+#include "mshr.h"
+#include "prefetch.h"
+
+#define SNAPSHOT_MAGIC "SESNAP01"
+#define NUM_PIPES 5
+
+extern machine_t guest;
+extern uint64_t F_PC;
+extern bool X_condval;
+extern int64_t W_wval;
+extern mem_status_t dmem_status;
+extern uint64_t inflight_cycles;
+extern uint64_t inflight_addr;
+extern bool inflight;
+extern mem_status_t imem_status;
+extern uint64_t imem_inflight_cycles;
+extern uint64_t imem_inflight_addr;
+extern bool imem_inflight;
+extern int hit_count;
+extern int miss_count;
+extern int dirty_eviction_count;
+extern int clean_eviction_count;
+extern __thread uword_t next_lru;
+
+typedef struct snapshot_level {
+    unsigned A, B, C, latency;
+    repl_policy_t policy;
+    uword_t rng;
+    uint64_t hits, misses, writebacks;
+    uint64_t read_bytes, write_bytes;
+    uint64_t num_lines, num_sets;
+} snapshot_level_t;
+
+typedef struct snapshot_header {
+    char magic[8];
+    uint64_t header_size;           // sizeof(snapshot_header_t), as a format check
+    uint64_t num_instr;
+    // Architectural state
+    uint64_t gpr[31];
+    uint64_t sp;
+    uint64_t pc;
+    uint8_t nzcv;
+    stat_t status;
+    uint64_t seg_start_addr[KERNEL_SEG+1];
+    // Pipeline registers and the signals passed between stages
+    pipe_ctl_stat_t ctl[NUM_PIPES];
+    f_instr_impl_t f_reg[2];        // in, out
+    d_instr_impl_t d_reg[2];
+    x_instr_impl_t x_reg[2];
+    m_instr_impl_t m_reg[2];
+    w_instr_impl_t w_reg[2];
+    uint64_t F_PC;
+    bool X_condval;
+    int64_t W_wval;
+    // Cache and miss state; num_levels is 0 if there was no cache
+    int num_levels;
+    bool icache;                    // levels[num_levels] is an L1I
+    snapshot_level_t levels[MAX_CACHE_LEVELS + 1];
+    fill_policy_t fill;
+    bool write_through, write_allocate;
+    unsigned victim_lines;          // Stored after the levels; 0 for none
+    uword_t victim_clock;
+    unsigned long victim_hits, victim_misses;
+    write_buffer_t wbuf;            // Its stores are already below; only timing
+    mem_status_t dmem_status;
+    uint64_t inflight_cycles;
+    uint64_t inflight_addr;
+    bool inflight;
+    mem_status_t imem_status;
+    uint64_t imem_inflight_cycles;
+    uint64_t imem_inflight_addr;
+    bool imem_inflight;
+    mshr_file_t mshrs;
+    prefetcher_t prefetcher;
+    int hit_count, miss_count, dirty_eviction_count, clean_eviction_count;
+    uword_t next_lru;
+    // Sections
+    uint64_t num_pages;
+    uint64_t lines_offset;
+    uint64_t pages_offset;          // Page-aligned
+} snapshot_header_t;
+
+typedef struct snapshot_line {
+    bool valid;
+    bool dirty;
+    bool prefetched;                // L1D only: prefetched, not yet used
+    uword_t tag;
+    uword_t lru;
+} snapshot_line_t;
+
+typedef struct snapshot_page {
+    uint64_t pnum;
+    uint32_t prot;
+    bool zero;                      // Backed by the zero page; no payload
+} snapshot_page_t;
+
+static char printbuf[BUF_LEN];
+
+static void snapshot_fail(const char *msg) {
+    logging(LOG_FATAL, (char *) msg);
+    exit(EXIT_FAILURE);
+}
+
+// The pipeline registers, in the order they are stored.
+static pipe_reg_t *pipe_reg(const int i) {
+    pipe_reg_t *pipes[NUM_PIPES] = {F_instr, D_instr, X_instr, M_instr, W_instr};
+    return pipes[i];
+}
+
+// Pipeline register halves in the header, in pipe_reg() order.
+static void *pipe_half(snapshot_header_t *h, const int i, const int side) {
+    void *halves[NUM_PIPES] = {&h->f_reg[side], &h->d_reg[side], &h->x_reg[side],
+                               &h->m_reg[side], &h->w_reg[side]};
+    return halves[i];
+}
+
+// Bytes a cache level takes up in the file.
+static uint64_t level_size(const snapshot_level_t *l) {
+    return l->num_lines * (sizeof(snapshot_line_t) + l->B) + l->num_sets * REPL_WORDS * sizeof(uword_t);
+}
+
+// Bytes the L1D's victim cache takes up in the file.
+static uint64_t victim_size(const snapshot_header_t *h) {
+    return h->victim_lines * (sizeof(snapshot_line_t) + h->levels[0].B);
+}
+
+// The caches in the order they are stored: the data levels, then the L1I.
+static cache_level_t *saved_level(const int i) {
+    return i < hierarchy.num_levels ? &hierarchy.levels[i] : &hierarchy.icache;
+}
+
+// Caches stored in a snapshot.
+static int num_saved(const snapshot_header_t *h) {
+    return h->num_levels + h->icache;
+}
+
+// Whether the snapshot's caches can be loaded into the ones set up for this run.
+static bool same_caches(const snapshot_header_t *h) {
+    int n = guest.cache ? hierarchy.num_levels : 0;
+    if (h->num_levels != n || (n && h->fill != hierarchy.fill) || h->icache != (NULL != guest.icache) ||
+        h->mshrs.num != mshrs.num || h->prefetcher.kind != prefetcher.kind ||
+        h->write_through != hierarchy.write_through || h->write_allocate != hierarchy.write_allocate ||
+        h->wbuf.depth != hierarchy.wbuf.depth ||
+        h->victim_lines != (n && guest.cache->victim ? guest.cache->victim->lines : 0))
+        return false;
+    for (int i = 0; i < num_saved(h); i++) {
+        cache_t *cache = saved_level(i)->cache;
+        const snapshot_level_t *l = &h->levels[i];
+        if (l->A != cache->A || l->B != cache->B || l->C != cache->C || l->policy != cache->policy)
+            return false;
+    }
+    return true;
+}
+
+typedef struct page_list {
+    pte_ptr_t *ptes;
+    uint64_t n, cap;
+} page_list_t;
+
+static void collect_page(pte_ptr_t page, void *arg) {
+    page_list_t *list = arg;
+    if (list->n == list->cap) {
+        list->cap = list->cap ? 2 * list->cap : 1024;
+        list->ptes = realloc(list->ptes, list->cap * sizeof(pte_ptr_t));
+    }
+    list->ptes[list->n++] = page;
+}
+
+void save_snapshot(const char *name) {
+    if (MEM_PTABLE != mem_backend) {
+        logging(LOG_INFO, "Snapshots need the ptable backend, not saving one.");
+        return;
+    }
+    FILE *f = fopen(name, "w");
+    if (NULL == f) {
+        perror(name);
+        exit(EXIT_FAILURE);
+    }
+
+    snapshot_header_t h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic));
+    h.header_size = sizeof(h);
+    h.num_instr = num_instr;
+    for (int i = 0; i < 31; i++)
+        h.gpr[i] = guest.proc->GPR.bits[i].xval;
+    h.sp = guest.proc->SP.bits->xval;
+    h.pc = guest.proc->PC.bits->xval;
+    h.nzcv = guest.proc->NZCV.bits->ccval;
+    h.status = guest.proc->status;
+    memcpy(h.seg_start_addr, guest.mem->seg_start_addr, sizeof(h.seg_start_addr));
+    for (int i = 0; i < NUM_PIPES; i++) {
+        pipe_reg_t *pipe = pipe_reg(i);
+        h.ctl[i] = pipe->ctl;
+        memcpy(pipe_half(&h, i, 0), pipe->in.generic, pipe->size);
+        memcpy(pipe_half(&h, i, 1), pipe->out.generic, pipe->size);
+    }
+    h.F_PC = F_PC;
+    h.X_condval = X_condval;
+    h.W_wval = W_wval;
+
+    if (guest.cache) {
+        h.num_levels = hierarchy.num_levels;
+        h.fill = hierarchy.fill;
+        h.icache = NULL != guest.icache;
+        h.write_through = hierarchy.write_through;
+        h.write_allocate = hierarchy.write_allocate;
+        h.wbuf = hierarchy.wbuf;
+        if (guest.cache->victim) {
+            h.victim_lines = guest.cache->victim->lines;
+            h.victim_clock = guest.cache->victim->clock;
+            h.victim_hits = guest.cache->victim->hits;
+            h.victim_misses = guest.cache->victim->misses;
+        }
+    }
+    for (int i = 0; i < num_saved(&h); i++) {
+        cache_level_t *l = saved_level(i);
+        snapshot_level_t *sl = &h.levels[i];
+        sl->A = l->cache->A;
+        sl->B = l->cache->B;
+        sl->C = l->cache->C;
+        sl->latency = l->latency;
+        sl->policy = l->cache->policy;
+        sl->rng = l->cache->rng;
+        sl->hits = l->hits;
+        sl->misses = l->misses;
+        sl->writebacks = l->writebacks;
+        sl->read_bytes = l->read_bytes;
+        sl->write_bytes = l->write_bytes;
+        sl->num_lines = l->cache->C / l->cache->B;
+        sl->num_sets = l->cache->S;
+    }
+    h.dmem_status = dmem_status;
+    h.inflight_cycles = inflight_cycles;
+    h.inflight_addr = inflight_addr;
+    h.inflight = inflight;
+    h.imem_status = imem_status;
+    h.imem_inflight_cycles = imem_inflight_cycles;
+    h.imem_inflight_addr = imem_inflight_addr;
+    h.imem_inflight = imem_inflight;
+    h.mshrs = mshrs;
+    h.prefetcher = prefetcher;
+    h.hit_count = hit_count;
+    h.miss_count = miss_count;
+    h.dirty_eviction_count = dirty_eviction_count;
+    h.clean_eviction_count = clean_eviction_count;
+    h.next_lru = next_lru;
+
+    page_list_t pages = {NULL, 0, 0};
+    walk_ptable(collect_page, &pages);
+    h.num_pages = pages.n;
+    h.lines_offset = sizeof(h);
+    uint64_t end = h.lines_offset + h.num_pages * sizeof(snapshot_page_t);
+    for (int i = 0; i < num_saved(&h); i++)
+        end += level_size(&h.levels[i]);
+    end += victim_size(&h);
+    h.pages_offset = (end + PAGESIZE - 1) / PAGESIZE * PAGESIZE;
+
+    fwrite(&h, sizeof(h), 1, f);
+    for (int l = 0; l < num_saved(&h); l++) {
+        cache_t *cache = saved_level(l)->cache;
+        for (uint64_t i = 0; i < h.levels[l].num_lines; i++) {
+            snapshot_line_t line = {cache->valid[i], cache->dirty[i], 0 == l && prefetch_line_unused(i),
+                                    cache->tags[i], cache->lru[i]};
+            fwrite(&line, sizeof(line), 1, f);
+        }
+        fwrite(cache->data, cache->B, h.levels[l].num_lines, f);
+        fwrite(cache->repl, REPL_WORDS * sizeof(uword_t), h.levels[l].num_sets, f);
+    }
+    if (h.victim_lines) {
+        victim_cache_t *v = guest.cache->victim;
+        for (unsigned i = 0; i < v->lines; i++) {
+            snapshot_line_t line = {v->valid[i], v->dirty[i], false, v->addrs[i], v->lru[i]};
+            fwrite(&line, sizeof(line), 1, f);
+        }
+        fwrite(v->data, guest.cache->B, v->lines, f);
+    }
+    for (uint64_t i = 0; i < pages.n; i++) {
+        snapshot_page_t p;
+        memset(&p, 0, sizeof(p));
+        p.pnum = pages.ptes[i]->p_num;
+        p.prot = pages.ptes[i]->p_prot;
+        p.zero = page_is_zero(pages.ptes[i]);
+        fwrite(&p, sizeof(p), 1, f);
+    }
+    fseek(f, h.pages_offset, SEEK_SET);
+    for (uint64_t i = 0; i < pages.n; i++) {
+        if (!page_is_zero(pages.ptes[i]))
+            fwrite(pages.ptes[i]->p_data, 1, PAGESIZE, f);
+    }
+    if (ferror(f) || fclose(f)) {
+        perror(name);
+        exit(EXIT_FAILURE);
+    }
+    free(pages.ptes);
+    sprintf(printbuf, "Saved snapshot after %ld cycles", num_instr);
+    logging(LOG_INFO, printbuf);
+}
+
+void restore_snapshot(const char *name) {
+    if (MEM_PTABLE != mem_backend)
+        snapshot_fail("Snapshots need the ptable backend.");
+    int fd = open(name, O_RDONLY);
+    if (fd < 0) {
+        perror(name);
+        exit(EXIT_FAILURE);
+    }
+    struct stat statBuffer;
+    if (fstat(fd, &statBuffer) != 0) {
+        perror("stat");
+        exit(EXIT_FAILURE);
+    }
+    if ((size_t) statBuffer.st_size < sizeof(snapshot_header_t))
+        snapshot_fail("Snapshot file is truncated.");
+    char *base = mmap(0, statBuffer.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (MAP_FAILED == base) {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+
+    snapshot_header_t *h = (snapshot_header_t *) base;
+    if (memcmp(h->magic, SNAPSHOT_MAGIC, sizeof(h->magic)) || h->header_size != sizeof(*h))
+        snapshot_fail("Not a snapshot written by this emulator.");
+    uint64_t payloads = 0;
+    if (h->num_levels < 0 || h->num_levels > MAX_CACHE_LEVELS)
+        snapshot_fail("Not a snapshot written by this emulator.");
+    char *levels[MAX_CACHE_LEVELS + 2];
+    levels[0] = base + h->lines_offset;
+    for (int i = 0; i < num_saved(h); i++)
+        levels[i + 1] = levels[i] + level_size(&h->levels[i]);
+    if (h->victim_lines > VICTIM_MAX)
+        snapshot_fail("Not a snapshot written by this emulator.");
+    snapshot_line_t *victim_lines = (snapshot_line_t *) levels[num_saved(h)];
+    snapshot_page_t *pages = (snapshot_page_t *) (levels[num_saved(h)] + victim_size(h));
+    for (uint64_t i = 0; i < h->num_pages; i++)
+        payloads += !pages[i].zero;
+    if ((char *) (pages + h->num_pages) > base + h->pages_offset ||
+        h->pages_offset + payloads * PAGESIZE > (uint64_t) statBuffer.st_size)
+        snapshot_fail("Snapshot file is truncated.");
+
+    num_instr = h->num_instr;
+    for (int i = 0; i < 31; i++)
+        guest.proc->GPR.bits[i].xval = h->gpr[i];
+    guest.proc->SP.bits->xval = h->sp;
+    guest.proc->PC.bits->xval = h->pc;
+    guest.proc->NZCV.bits->ccval = h->nzcv;
+    guest.proc->status = h->status;
+    memcpy(guest.mem->seg_start_addr, h->seg_start_addr, sizeof(h->seg_start_addr));
+    mem_update_segments();
+
+    init_pipeline();
+    for (int i = 0; i < NUM_PIPES; i++) {
+        pipe_reg_t *pipe = pipe_reg(i);
+        pipe->ctl = h->ctl[i];
+        memcpy(pipe->in.generic, pipe_half(h, i, 0), pipe->size);
+        memcpy(pipe->out.generic, pipe_half(h, i, 1), pipe->size);
+    }
+    F_PC = h->F_PC;
+    X_condval = h->X_condval;
+    W_wval = h->W_wval;
+
+    // The cache contents only carry over to caches of the same geometry
+    // and replacement policy.
+    if (same_caches(h)) {
+        for (int l = 0; l < num_saved(h); l++) {
+            cache_level_t *level = saved_level(l);
+            cache_t *cache = level->cache;
+            snapshot_line_t *lines = (snapshot_line_t *) levels[l];
+            uint64_t n = h->levels[l].num_lines;
+            byte_t *data = (byte_t *) (lines + n);
+            for (uint64_t i = 0; i < n; i++) {
+                cache->valid[i] = lines[i].valid;
+                cache->dirty[i] = lines[i].dirty;
+                cache->tags[i] = lines[i].tag;
+                cache->lru[i] = lines[i].lru;
+                if (0 == l)
+                    prefetch_set_line_unused(i, lines[i].prefetched);
+            }
+            memcpy(cache->data, data, n * cache->B);
+            memcpy(cache->repl, data + n * cache->B, h->levels[l].num_sets * REPL_WORDS * sizeof(uword_t));
+            cache->rng = h->levels[l].rng;
+            level->hits = h->levels[l].hits;
+            level->misses = h->levels[l].misses;
+            level->writebacks = h->levels[l].writebacks;
+            level->read_bytes = h->levels[l].read_bytes;
+            level->write_bytes = h->levels[l].write_bytes;
+        }
+        if (h->num_levels)
+            hierarchy.wbuf = h->wbuf;
+        if (h->victim_lines) {
+            victim_cache_t *v = guest.cache->victim;
+            for (unsigned i = 0; i < v->lines; i++) {
+                v->valid[i] = victim_lines[i].valid;
+                v->dirty[i] = victim_lines[i].dirty;
+                v->addrs[i] = victim_lines[i].tag;
+                v->lru[i] = victim_lines[i].lru;
+            }
+            memcpy(v->data, victim_lines + v->lines, (size_t) v->lines * guest.cache->B);
+            v->clock = h->victim_clock;
+            v->hits = h->victim_hits;
+            v->misses = h->victim_misses;
+        }
+        dmem_status = h->dmem_status;
+        inflight_cycles = h->inflight_cycles;
+        inflight_addr = h->inflight_addr;
+        inflight = h->inflight;
+        imem_status = h->imem_status;
+        imem_inflight_cycles = h->imem_inflight_cycles;
+        imem_inflight_addr = h->imem_inflight_addr;
+        imem_inflight = h->imem_inflight;
+        mshrs = h->mshrs;
+        prefetcher = h->prefetcher;
+        hit_count = h->hit_count;
+        miss_count = h->miss_count;
+        dirty_eviction_count = h->dirty_eviction_count;
+        clean_eviction_count = h->clean_eviction_count;
+        next_lru = h->next_lru;
+    }
+    else {
+        logging(LOG_INFO, "Caches differ from the snapshot, starting cold.");
+        // A dirty line in the snapshot's caches holds data memory does not have yet.
+        for (int l = 0; l < h->num_levels; l++) {
+            snapshot_line_t *lines = (snapshot_line_t *) levels[l];
+            for (uint64_t i = 0; i < h->levels[l].num_lines; i++) {
+                if (lines[i].valid && lines[i].dirty)
+                    snapshot_fail("Snapshot cache has dirty lines, cannot change the cache.");
+            }
+        }
+        for (unsigned i = 0; i < h->victim_lines; i++) {
+            if (victim_lines[i].valid && victim_lines[i].dirty)
+                snapshot_fail("Snapshot cache has dirty lines, cannot change the cache.");
+        }
+        for (int i = 0; i < h->mshrs.num; i++) {
+            if (h->mshrs.entries[i].valid && h->mshrs.entries[i].num_stores)
+                snapshot_fail("Snapshot has stores in its MSHRs, cannot change the cache.");
+        }
+    }
+
+    char *payload = base + h->pages_offset;
+    for (uint64_t i = 0; i < h->num_pages; i++) {
+        if (pages[i].zero)
+            add_zero_page(pages[i].pnum, pages[i].prot);
+        else {
+            add_cow_page(pages[i].pnum, pages[i].prot, payload);
+            payload += PAGESIZE;
+        }
+    }
+    tlb_flush();
+    sprintf(printbuf, "Restored snapshot after %ld cycles", num_instr);
+    logging(LOG_INFO, printbuf);
+}
@@ -0,0 +1,42 @@
+/**************************************************************************
+ * C S 429 system emulator
+ * 
+ * tlb.c - Module for the software TLB in front of the page table.
+ * 
+ * Entries are filled by the memory module on a miss. They must be dropped
+ * whenever the PTE they were filled from changes: add_page() invalidates
+ * the entry for the new page, and anything that changes page protections
+ * flushes the whole TLB.
+ * 
+ * Copyright (c) 2023.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/ 
+
+#include "tlb.h"
+
+tlb_entry_t tlb[TLB_ENTRIES] = {
+    [0 ... TLB_ENTRIES-1] = {.t_num = TLB_INVALID}
+};
+uint64_t tlb_hits;
+uint64_t tlb_misses;
+
+tlb_entry_t *tlb_fill(const pte_ptr_t page) {
+    tlb_entry_t *e = &tlb[page->p_num & (TLB_ENTRIES - 1)];
+    e->t_num = page->p_num;
+    e->t_data = page->p_data;
+    e->t_prot = page->p_prot;
+    e->t_writable = !page->p_cow && page->p_dirty;
+    return e;
+}
+
+void tlb_invalidate(const uint64_t pnum) {
+    tlb_entry_t *e = &tlb[pnum & (TLB_ENTRIES - 1)];
+    if (e->t_num == pnum)
+        e->t_num = TLB_INVALID;
+}
+
+void tlb_flush(void) {
+    for (int i = 0; i < TLB_ENTRIES; i++)
+        tlb[i].t_num = TLB_INVALID;
+}
@@ -3,8 +3,13 @@
  * 
  * cache.c - A cache simulator that can replay traces from Valgrind
  *     and output statistics such as number of hits, misses, and
- *     evictions, both dirty and clean.  The replacement policy is LRU. 
- *     The cache is a writeback cache. 
+ *     evictions, both dirty and clean.  The replacement policy is LRU
+ *     by default; tree-PLRU, bit-PLRU, SRRIP, BRRIP, FIFO and random can
+ *     be chosen through repl_policy. The cache is a writeback cache,
+ *     optionally with a victim cache beside it.
+ * 
+ *     Lookups compare the tag against all ways of a set with AVX2 or
+ *     SSE4.1 when the host has them, and one way at a time otherwise.
  * 
  * Copyright (c) 2021, 2023. 
  * Authors: M. Hinton, Z. Leeper.
@@ -19,9 +24,13 @@
 #include <limits.h>
 #include <string.h>
 #include <errno.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 #include "cache.h"
 
 #define ADDRESS_LENGTH 64
+#define BATCH_PREFETCH 8    /* Accesses ahead whose sets access_batch() prefetches */
 
 /* Counters used to record cache statistics in printSummary().
    test-cache uses these numbers to verify correctness of the cache. */
@@ -39,7 +48,8 @@ int dirty_eviction_count = 0;
 int clean_eviction_count = 0;
 
 /* STUDENT TO-DO: add more globals, structs, macros if necessary */
-uword_t next_lru;
+/* Per thread, so that csim's sweep workers can each run their own caches */
+__thread uword_t next_lru;
 
 // log base 2 of a number.
 // Useful for getting certain cache parameters
@@ -51,6 +61,188 @@ static size_t _log(size_t x) {
   return result;
 }
 
+/*
+ * Tag compare over the ways of one set: return the first way whose tag
+ * matches and whose line is valid, or -1. Invalid lines may hold any tag,
+ * so a tag match is only a candidate until its valid bit is checked.
+ * create_cache() picks the widest version the host CPU supports.
+ */
+static int find_way_scalar(const uword_t *tags, const bool *valid, unsigned int A, uword_t tag) {
+    for (unsigned int i = 0; i < A; i++) {
+        if (tags[i] == tag && valid[i])
+            return i;
+    }
+    return -1;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+static int find_way_avx2(const uword_t *tags, const bool *valid, unsigned int A, uword_t tag) {
+    __m256i key = _mm256_set1_epi64x((long long) tag);
+    unsigned int i = 0;
+    for (; i + 4 <= A; i += 4) {
+        __m256i eq = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *) (tags + i)), key);
+        unsigned int mask = _mm256_movemask_pd(_mm256_castsi256_pd(eq));
+        for (; mask; mask &= mask - 1) {
+            unsigned int way = i + __builtin_ctz(mask);
+            if (valid[way])
+                return way;
+        }
+    }
+    for (; i < A; i++) {
+        if (tags[i] == tag && valid[i])
+            return i;
+    }
+    return -1;
+}
+
+__attribute__((target("sse4.1")))
+static int find_way_sse41(const uword_t *tags, const bool *valid, unsigned int A, uword_t tag) {
+    __m128i key = _mm_set1_epi64x((long long) tag);
+    unsigned int i = 0;
+    for (; i + 2 <= A; i += 2) {
+        __m128i eq = _mm_cmpeq_epi64(_mm_loadu_si128((const __m128i *) (tags + i)), key);
+        unsigned int mask = _mm_movemask_pd(_mm_castsi128_pd(eq));
+        for (; mask; mask &= mask - 1) {
+            unsigned int way = i + __builtin_ctz(mask);
+            if (valid[way])
+                return way;
+        }
+    }
+    for (; i < A; i++) {
+        if (tags[i] == tag && valid[i])
+            return i;
+    }
+    return -1;
+}
+#endif
+
+static int (*find_way)(const uword_t *, const bool *, unsigned int, uword_t) = find_way_scalar;
+
+repl_policy_t repl_policy = REPL_LRU;
+
+static const char *repl_names[] = {"lru", "plru", "bitplru", "srrip", "brrip", "fifo", "random"};
+
+// Look up a policy by its flag name. Returns -1 if there is none.
+int parse_repl_policy(const char *name) {
+    for (int i = 0; i < (int) (sizeof(repl_names) / sizeof(repl_names[0])); i++) {
+        if (!strcmp(name, repl_names[i]))
+            return i;
+    }
+    return -1;
+}
+
+const char *repl_policy_name(repl_policy_t policy) {
+    return repl_names[policy];
+}
+
+// The per-set state holds one bit per way, and tree-PLRU needs a full tree.
+bool repl_policy_supported(repl_policy_t policy, unsigned int A) {
+    if (REPL_LRU == policy || REPL_FIFO == policy || REPL_RANDOM == policy)
+        return true;
+    if (A > 64)
+        return false;
+    return REPL_PLRU != policy || 0 == (A & (A - 1));
+}
+
+/*
+ * Replacement state, per set:
+ *   PLRU     word 0 bit n is node n of the tree (root 1, children 2n and
+ *            2n+1, ways at A..2A-1); a set bit means the victim is right.
+ *   BIT_PLRU word 0 bit w is the MRU bit of way w.
+ *   RRIP     word v is the set of ways whose re-reference prediction
+ *            value is v, 0 (near) to 3 (distant).
+ * FIFO keeps no state here: it evicts the line with the oldest lru, which
+ * it only sets on a fill, so a way refilled after an invalidation goes to
+ * the back of the queue.
+ */
+#define RRPV_MAX 3
+#define BRRIP_LONG_ODDS 32  // BRRIP inserts 1 in 32 fills at RRPV_MAX-1
+
+static uword_t way_mask(unsigned int A) {
+    return A >= 64 ? ~0ULL : (1ULL << A) - 1;
+}
+
+static uword_t repl_rand(cache_t *cache) {
+    uword_t x = cache->rng;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return cache->rng = x;
+}
+
+static void rrip_set(uword_t *rrpv, unsigned int way, unsigned int v) {
+    for (int i = 0; i <= RRPV_MAX; i++)
+        rrpv[i] &= ~(1ULL << way);
+    rrpv[v] |= 1ULL << way;
+}
+
+// Update the replacement state after an access to a way of a set.
+static void repl_touch(cache_t *cache, uword_t set, unsigned int way, bool fill) {
+    uword_t *state = cache->repl + set * REPL_WORDS;
+    switch (cache->policy) {
+        case REPL_PLRU:
+            for (unsigned int node = way + cache->A; node > 1; node >>= 1) {
+                if (node & 1)
+                    state[0] &= ~(1ULL << (node >> 1));
+                else
+                    state[0] |= 1ULL << (node >> 1);
+            }
+            break;
+        case REPL_BIT_PLRU:
+            state[0] |= 1ULL << way;
+            if (state[0] == way_mask(cache->A))
+                state[0] = 1ULL << way;
+            break;
+        case REPL_SRRIP:
+            rrip_set(state, way, fill ? RRPV_MAX - 1 : 0);
+            break;
+        case REPL_BRRIP:
+            if (!fill)
+                rrip_set(state, way, 0);
+            else if (repl_rand(cache) % BRRIP_LONG_ODDS)
+                rrip_set(state, way, RRPV_MAX);
+            else
+                rrip_set(state, way, RRPV_MAX - 1);
+            break;
+        default:
+            break;
+    }
+}
+
+// Pick the way to evict from a set whose ways are all valid.
+static unsigned int repl_victim(cache_t *cache, uword_t set) {
+    uword_t *state = cache->repl + set * REPL_WORDS;
+    switch (cache->policy) {
+        case REPL_PLRU: {
+            unsigned int node = 1;
+            while (node < cache->A)
+                node = 2 * node + ((state[0] >> node) & 1);
+            return node - cache->A;
+        }
+        case REPL_BIT_PLRU:
+            return __builtin_ctzll(~state[0] & way_mask(cache->A));
+        case REPL_SRRIP:
+        case REPL_BRRIP: {
+            // Age every way by the same amount, so the oldest reach RRPV_MAX.
+            int v = RRPV_MAX;
+            while (v > 0 && !state[v])
+                v--;
+            if (v < RRPV_MAX) {
+                int age = RRPV_MAX - v;
+                for (int i = RRPV_MAX; i >= 0; i--)
+                    state[i] = i >= age ? state[i - age] : 0;
+            }
+            return __builtin_ctzll(state[RRPV_MAX]);
+        }
+        case REPL_RANDOM:
+            return repl_rand(cache) % cache->A;
+        default:
+            assert(false);
+            return 0;
+    }
+}
+
 /*
  * Initialize the cache according to specified arguments
  * Called by cache-runner so do not modify the function signature
@@ -65,19 +257,34 @@ cache_t *create_cache(int A_in, int B_in, int C_in, int d_in) {
     cache->B = B_in;
     cache->C = C_in;
     cache->d = d_in;
-    unsigned int S = cache->C / (cache->A * cache->B);
-
-    cache->sets = (cache_set_t*) calloc(S, sizeof(cache_set_t));
-    for (unsigned int i = 0; i < S; i++){
-        cache->sets[i].lines = (cache_line_t*) calloc(cache->A, sizeof(cache_line_t));
-        for (unsigned int j = 0; j < cache->A; j++){
-            cache->sets[i].lines[j].valid = 0;
-            cache->sets[i].lines[j].tag   = 0;
-            cache->sets[i].lines[j].lru   = 0;
-            cache->sets[i].lines[j].dirty = 0;
-            cache->sets[i].lines[j].data  = calloc(cache->B, sizeof(byte_t));
-        }
-    }
+    unsigned int lines = cache->C / cache->B;
+
+    /* B and C/(A*B) are powers of two, so the address splits on bit
+       boundaries. Everything below tag_shift is offset and index. */
+    cache->S = lines / cache->A;
+    cache->b_bits = _log(cache->B);
+    cache->s_bits = _log(cache->S);
+    cache->tag_shift = cache->b_bits + cache->s_bits;
+    cache->off_mask = (uword_t) cache->B - 1;
+    cache->set_mask = (uword_t) cache->S - 1;
+
+    cache->tags  = calloc(lines, sizeof(uword_t));
+    cache->valid = calloc(lines, sizeof(bool));
+    cache->dirty = calloc(lines, sizeof(bool));
+    cache->lru   = calloc(lines, sizeof(uword_t));
+    cache->data  = calloc(lines, cache->B);
+    cache->policy = repl_policy;
+    cache->repl  = calloc((size_t) cache->S * REPL_WORDS, sizeof(uword_t));
+    cache->rng   = 0x2545f4914f6cdd1dULL;
+    cache->victim = NULL;
+
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        find_way = find_way_avx2;
+    else if (__builtin_cpu_supports("sse4.1"))
+        find_way = find_way_sse41;
+#endif
 
     // make gcc happy, replace this with zero and comment out _log if you want
     next_lru = _log(0);
@@ -85,29 +292,45 @@ cache_t *create_cache(int A_in, int B_in, int C_in, int d_in) {
 }
 
 cache_t *create_checkpoint(cache_t *cache) {
-    unsigned int S = (unsigned int) cache->C / (cache->A * cache->B);
+    unsigned int lines = cache->C / cache->B;
     cache_t *copy_cache = malloc(sizeof(cache_t));
     memcpy(copy_cache, cache, sizeof(cache_t));
-    copy_cache->sets = (cache_set_t*) calloc(S, sizeof(cache_set_t));
-    for (unsigned int i = 0; i < S; i++) {
-        copy_cache->sets[i].lines = (cache_line_t*) calloc(cache->A, sizeof(cache_line_t));
-        for (unsigned int j = 0; j < cache->A; j++) {
-            memcpy(&copy_cache->sets[i].lines[j], &cache->sets[i].lines[j], sizeof(cache_line_t));
-            copy_cache->sets[i].lines[j].data = calloc(cache->B, sizeof(byte_t));
-            memcpy(copy_cache->sets[i].lines[j].data, cache->sets[i].lines[j].data, sizeof(byte_t));
-        }
+    copy_cache->tags  = malloc(lines * sizeof(uword_t));
+    copy_cache->valid = malloc(lines * sizeof(bool));
+    copy_cache->dirty = malloc(lines * sizeof(bool));
+    copy_cache->lru   = malloc(lines * sizeof(uword_t));
+    copy_cache->data  = malloc((size_t) lines * cache->B);
+    copy_cache->repl  = malloc((size_t) cache->S * REPL_WORDS * sizeof(uword_t));
+    memcpy(copy_cache->tags, cache->tags, lines * sizeof(uword_t));
+    memcpy(copy_cache->valid, cache->valid, lines * sizeof(bool));
+    memcpy(copy_cache->dirty, cache->dirty, lines * sizeof(bool));
+    memcpy(copy_cache->lru, cache->lru, lines * sizeof(uword_t));
+    memcpy(copy_cache->data, cache->data, (size_t) lines * cache->B);
+    memcpy(copy_cache->repl, cache->repl, (size_t) cache->S * REPL_WORDS * sizeof(uword_t));
+    if (cache->victim) {
+        victim_cache_t *v = cache->victim;
+        copy_cache->victim = NULL;
+        cache_add_victim(copy_cache, v->lines);
+        victim_cache_t *c = copy_cache->victim;
+        memcpy(c->addrs, v->addrs, v->lines * sizeof(uword_t));
+        memcpy(c->valid, v->valid, v->lines * sizeof(bool));
+        memcpy(c->dirty, v->dirty, v->lines * sizeof(bool));
+        memcpy(c->lru, v->lru, v->lines * sizeof(uword_t));
+        memcpy(c->data, v->data, (size_t) v->lines * cache->B);
+        c->clock = v->clock;
+        c->hits = v->hits;
+        c->misses = v->misses;
     }
     
     return copy_cache;
 }
 
 void display_set(cache_t *cache, unsigned int set_index) {
-    unsigned int S = (unsigned int) cache->C / (cache->A * cache->B);
+    unsigned int S = cache->S;
     if (set_index < S) {
-        cache_set_t *set = &cache->sets[set_index];
-        for (unsigned int i = 0; i < cache->A; i++) {
-            printf ("Valid: %d Tag: %llx Lru: %lld Dirty: %d\n", set->lines[i].valid, 
-                set->lines[i].tag, set->lines[i].lru, set->lines[i].dirty);
+        for (unsigned int i = set_index * cache->A; i < (set_index + 1) * cache->A; i++) {
+            printf ("Valid: %d Tag: %llx Lru: %lld Dirty: %d\n", cache->valid[i], 
+                cache->tags[i], cache->lru[i], cache->dirty[i]);
         }
     } else {
         printf ("Invalid Set %d. 0 <= Set < %d\n", set_index, S);
@@ -118,164 +341,292 @@ void display_set(cache_t *cache, unsigned int set_index) {
  * Free allocated memory. Feel free to modify it
  */
 void free_cache(cache_t *cache) {
-    unsigned int S = (unsigned int) cache->C / (cache->A * cache->B);
-    for (unsigned int i = 0; i < S; i++){
-        for (unsigned int j = 0; j < cache->A; j++) {
-            free(cache->sets[i].lines[j].data);
-        }
-        free(cache->sets[i].lines);
+    free(cache->tags);
+    free(cache->valid);
+    free(cache->dirty);
+    free(cache->lru);
+    free(cache->data);
+    free(cache->repl);
+    if (cache->victim) {
+        free(cache->victim->addrs);
+        free(cache->victim->valid);
+        free(cache->victim->dirty);
+        free(cache->victim->lru);
+        free(cache->victim->data);
+        free(cache->victim->swap);
+        free(cache->victim->spill);
+        free(cache->victim);
     }
-    free(cache->sets);
     free(cache);
 }
 
+void cache_add_victim(cache_t *cache, unsigned int lines) {
+    victim_cache_t *v = calloc(1, sizeof(victim_cache_t));
+    v->lines = lines;
+    v->addrs = calloc(lines, sizeof(uword_t));
+    v->valid = calloc(lines, sizeof(bool));
+    v->dirty = calloc(lines, sizeof(bool));
+    v->lru   = calloc(lines, sizeof(uword_t));
+    v->data  = calloc(lines, cache->B);
+    v->swap  = malloc(cache->B);
+    v->spill = malloc(cache->B);
+    cache->victim = v;
+}
+
+long victim_find(cache_t *cache, uword_t addr) {
+    victim_cache_t *v = cache->victim;
+    uword_t block = addr & ~cache->off_mask;
+    for (unsigned int i = 0; i < v->lines; i++) {
+        if (v->valid[i] && v->addrs[i] == block)
+            return i;
+    }
+    return -1;
+}
+
+/*
+ * Put a line the cache evicted into victim cache line i, and hand back
+ * in *line what was there before.
+ */
+static void victim_exchange(cache_t *cache, long i, evicted_line_t *line) {
+    victim_cache_t *v = cache->victim;
+    byte_t *slot = v->data + i * cache->B;
+    evicted_line_t out = {v->valid[i], v->dirty[i], v->addrs[i], line->data};
+    memcpy(v->swap, slot, cache->B);
+    memcpy(slot, line->data, cache->B);
+    v->valid[i] = line->valid;
+    v->dirty[i] = line->dirty;
+    v->addrs[i] = line->addr;
+    v->lru[i] = ++v->clock;
+    memcpy(line->data, v->swap, cache->B);
+    *line = out;
+}
+
+// The invalid line of the victim cache, or else its least recently used one.
+static long victim_select(victim_cache_t *v) {
+    long pick = 0;
+    for (unsigned int i = 0; i < v->lines; i++) {
+        if (!v->valid[i])
+            return i;
+        if (v->lru[i] < v->lru[pick])
+            pick = i;
+    }
+    return pick;
+}
+
+bool victim_hit(cache_t *cache, uword_t addr, operation_t operation) {
+    victim_cache_t *v = cache->victim;
+    long i = victim_find(cache, addr);
+    if (i < 0) {
+        v->misses++;
+        return false;
+    }
+    v->hits++;
+    // The block moves into the cache, and the line it displaces takes its place.
+    memcpy(v->swap, v->data + i * cache->B, cache->B);
+    evicted_line_t displaced = {.data = v->data + i * cache->B};
+    cache_insert(cache, addr, v->swap, v->dirty[i] || operation == WRITE, &displaced);
+    v->valid[i] = displaced.valid;
+    v->dirty[i] = displaced.dirty;
+    v->addrs[i] = displaced.addr;
+    v->lru[i] = ++v->clock;
+    return true;
+}
+
 /* STUDENT TO-DO:
  * Get the line for address contained in the cache
- * On hit, return the cache line holding the address
- * On miss, returns NULL
+ * On hit, return the index of the line holding the address
+ * On miss, returns -1
  */
 // Define a function named "get_line" that takes in a pointer to a cache and an address
-cache_line_t *get_line(cache_t *cache, uword_t addr) {
-    // Calculate the number of bits in a block offset
-    size_t bSize = _log(cache->B); 
-    // Calculate the number of bits in a set index
-    size_t sSize = _log(cache->C / (cache->A * cache->B)); 
-    // Extract the set index from the address using a bitmask
-    uword_t setIndex = (addr >> bSize) & ((1 << sSize) -1); 
-    // Extract the tag value from the address using a bitmask
-    uword_t tag = (addr >> (bSize+sSize)) & ((1 << (ADDRESS_LENGTH - sSize - bSize)) -1); 
-     // Iterate over each line in the set
-    for(int i = 0; i < cache->A; i++){ 
-         // Check if the tag value matches and the line is valid
-        if(cache->sets[setIndex].lines[i].tag == tag && cache->sets[setIndex].lines[i].valid) { 
-             // Return a pointer to the matching line
-            return &(cache->sets[setIndex].lines[i]); 
-        }
-    }
-    // If no matching line is found, return NULL
-    return NULL; 
+long get_line(cache_t *cache, uword_t addr) {
+    // Split the address with the masks create_cache() worked out
+    uword_t setIndex = (addr >> cache->b_bits) & cache->set_mask; 
+    uword_t tag = addr >> cache->tag_shift; 
+    // Compare the tag against every line in the set at once
+    size_t first = setIndex * cache->A;
+    int way = find_way(cache->tags + first, cache->valid + first, cache->A, tag);
+    // If no matching line is found, return -1
+    return way < 0 ? -1 : (long) (first + way); 
 }
 
 /* STUDENT TO-DO:
  * Select the line to fill with the new cache line
- * Return the cache line selected to filled in by addr
+ * Return the index of the line selected to filled in by addr
  */
 // Define a function named "select_line" that takes in a pointer to a cache and an address
-cache_line_t *select_line(cache_t *cache, uword_t addr) {
-    // Calculate the number of bits in a block offset
-    size_t bSize = _log(cache->B); 
-    // Calculate the number of bits in a set index
-    size_t sSize = _log(cache->C / (cache->A * cache->B)); 
+long select_line(cache_t *cache, uword_t addr) {
     // Extract the set index from the address using a bitmask
-    uword_t setIndex = (addr >> bSize) & ((1 << sSize) -1); 
+    uword_t setIndex = (addr >> cache->b_bits) & cache->set_mask; 
+    size_t first = setIndex * cache->A;
+    // If there is an invalid line, return it
+    bool *invalid = memchr(cache->valid + first, false, cache->A);
+    if (invalid) {
+        return invalid - cache->valid;
+    }
+    if (cache->policy != REPL_LRU && cache->policy != REPL_FIFO) {
+        return first + repl_victim(cache, setIndex);
+    }
     // Initialize current least-recently-used value to be the maximum possible value
     uword_t currLRU = 0xfffffffffffff;
-    // Create a pointer to the cache line that will be replaced
-    cache_line_t *lineToReplace; 
+    // The line that will be replaced
+    long lineToReplace = first; 
     // Iterate over each line in the set
-    for(int i = 0; i < cache->A; i++){ 
+    for(size_t i = first; i < first + cache->A; i++){ 
         // Otherwise, find the least-recently-used line
-        if(!cache->sets[setIndex].lines[i].valid) { 
-            return &(cache->sets[setIndex].lines[i]); 
-        }
-        // If there is an invalid line, return a pointer to it
-        if(cache->sets[setIndex].lines[i].lru < currLRU) { 
-            lineToReplace = &(cache->sets[setIndex].lines[i]); 
-            currLRU = cache->sets[setIndex].lines[i].lru; 
+        if(cache->lru[i] < currLRU) { 
+            lineToReplace = i; 
+            currLRU = cache->lru[i]; 
         }
     }
-     // Return a pointer to the least-recently-used line
+     // Return the least-recently-used line
     return lineToReplace; 
 }
 
-/*  STUDENT TO-DO:
- *  Check if the address is hit in the cache, updating hit and miss data.
- *  Return true if pos hits in the cache.
+/*
+ * Mark a line that holds addr as just used.
  */
-// Define a function named "check_hit" that takes in a pointer to a cache, an address, and an operati
-bool check_hit(cache_t *cache, uword_t addr, operation_t operation) {
-     // Get a pointer to the cache line containing the address
-    cache_line_t *cacheLine = get_line(cache, addr); 
+void cache_touch(cache_t *cache, uword_t addr, long line) {
+    if (cache->policy == REPL_FIFO)
+        return;
+    // Increment the least-recently-used value and update the cache line's LRU value
+    next_lru++; 
+    cache->lru[line] = next_lru;
+    if (cache->policy != REPL_LRU) {
+        repl_touch(cache, (addr >> cache->b_bits) & cache->set_mask, line % cache->A, false);
+    }
+}
+
+/*
+ * The body of check_hit(), counted in *stats.
+ */
+static bool hit_line(cache_t *cache, uword_t addr, operation_t operation, cache_stats_t *stats) {
+     // Get the cache line containing the address
+    long line = get_line(cache, addr); 
      // If the cache line exists
-    if(cacheLine != NULL) { 
+    if(line >= 0) { 
         //increment the counter
-        hit_count++; 
+        stats->hits++; 
         if(operation == WRITE) { 
             //make sure to set it to dirty if the operation is WRITE
-            cacheLine ->dirty = 1; 
+            cache->dirty[line] = 1; 
         }
-        // Increment the least-recently-used value and update the cache line's LRU value
-        next_lru++; 
-        cacheLine ->lru = next_lru;
+        cache_touch(cache, addr, line);
         //return true indicating a hit 
         return true; 
     }
     else{ 
         // If the cache line does not exist, increment the miss count and return false, indicating a miss
-        miss_count++; 
+        stats->misses++; 
         return false; 
     }
 }
 
 /*  STUDENT TO-DO:
- *  Handles Misses, evicting from the cache if necessary.
- *  Fill out the evicted_line_t struct with info regarding the evicted line.
+ *  Check if the address is hit in the cache, updating hit and miss data.
+ *  Return true if pos hits in the cache.
  */
-evicted_line_t *handle_miss(cache_t *cache, uword_t addr, operation_t operation, byte_t *incoming_data)
-{
-    evicted_line_t *evicted_line = malloc(sizeof(evicted_line_t));
-    evicted_line->data = (byte_t *)calloc(cache->B, sizeof(byte_t));
-    /* your implementation */
-    // Calculate the number of bits required for the block offset and set index
-    size_t bSize = _log(cache->B);
-    size_t sSize = _log(cache->C / (cache->A * cache->B));
+// Define a function named "check_hit" that takes in a pointer to a cache, an address, and an operati
+bool check_hit(cache_t *cache, uword_t addr, operation_t operation) {
+    cache_stats_t stats = {0};
+    bool hit = hit_line(cache, addr, operation, &stats);
+    hit_count += stats.hits;
+    miss_count += stats.misses;
+    return hit;
+}
+
+long cache_find(cache_t *cache, uword_t addr) {
+    return get_line(cache, addr);
+}
 
-    // Extract tag value from the address
-    uword_t tagVal = (addr >> (bSize + sSize)) & ((1 << (ADDRESS_LENGTH - sSize - bSize)) - 1);
+uword_t cache_line_addr(cache_t *cache, long line) {
+    uword_t set = line / cache->A;
+    return (cache->tags[line] << cache->tag_shift) | (set << cache->b_bits);
+}
 
+/*
+ * Bring the block holding addr into the cache, replacing the line the
+ * replacement policy picks. The old contents of that line go to victim,
+ * whose data buffer (if any) must hold B bytes. Returns the new line.
+ */
+long cache_insert(cache_t *cache, uword_t addr, const byte_t *data, bool dirty, evicted_line_t *victim)
+{
     // Select a cache line for eviction or replacement
-    cache_line_t *selectedLine = select_line(cache, addr);
+    long selectedLine = select_line(cache, addr);
+    byte_t *selectedData = cache->data + selectedLine * cache->B;
 
     // Save evicted line data and metadata in the provided pointer
-    evicted_line->addr = addr;
-    memcpy(evicted_line->data, selectedLine->data, 8);
-    evicted_line->dirty = selectedLine->dirty;
-    evicted_line->valid = selectedLine->valid;
+    victim->valid = cache->valid[selectedLine];
+    victim->dirty = cache->dirty[selectedLine];
+    victim->addr = victim->valid ? cache_line_addr(cache, selectedLine) : 0;
+    if (victim->data != NULL)
+    {
+        memcpy(victim->data, selectedData, cache->B);
+    }
 
     // If incoming data is provided, update selected line's data with incoming data
-    if (incoming_data != NULL)
+    if (data != NULL)
     {
-        memcpy(selectedLine->data, incoming_data, 8);
+        memcpy(selectedData, data, cache->B);
     }
 
     // Update selected line's metadata and LRU count
-    selectedLine->dirty = 0;
     next_lru++;
-    selectedLine->lru = next_lru;
-    selectedLine->tag = tagVal;
-    selectedLine->valid = 1;
-
-    // If the operation is a write, set the selected line's dirty bit
-    if (operation == WRITE)
-    {
-        selectedLine->dirty = 1;        
+    cache->lru[selectedLine] = next_lru;
+    cache->tags[selectedLine] = addr >> cache->tag_shift;
+    cache->valid[selectedLine] = 1;
+    cache->dirty[selectedLine] = dirty;
+    if (cache->policy != REPL_LRU) {
+        repl_touch(cache, (addr >> cache->b_bits) & cache->set_mask, selectedLine % cache->A, true);
     }
+    return selectedLine;
+}
+
+void cache_invalidate(cache_t *cache, long line) {
+    cache->valid[line] = 0;
+    cache->dirty[line] = 0;
+}
+
+/*
+ * The body of handle_miss(), with the eviction counted in *stats, so that
+ * access_batch() can keep its counts apart from the globals.
+ */
+static void fill_line(cache_t *cache, uword_t addr, operation_t operation, byte_t *incoming_data,
+                      evicted_line_t *evicted_line, cache_stats_t *stats)
+{
+    if (!evicted_line->data && cache->victim)
+        evicted_line->data = cache->victim->spill;
+    cache_insert(cache, addr, incoming_data, operation == WRITE, evicted_line);
+    if (cache->victim && evicted_line->valid)
+        victim_exchange(cache, victim_select(cache->victim), evicted_line);
 
     // Check if the evicted line was clean or dirty and update respective counters
     if (evicted_line->valid)
     {
         if (evicted_line->dirty)
         {
-            dirty_eviction_count++;
+            stats->dirty_evictions++;
         }
         else
         {
-            clean_eviction_count++;
+            stats->clean_evictions++;
         }
     }
+}
 
-    // Return NULL since the evicted line has already been saved in evicted_line pointer
-    return NULL;
+/*  STUDENT TO-DO:
+ *  Handles Misses, evicting from the cache if necessary.
+ *  Fill out the caller's evicted_line_t with info regarding the evicted
+ *  line. Its data buffer, if not NULL, must hold B bytes; a victim cache
+ *  that needs the data when it is NULL uses its spill buffer instead.
+ *  Nothing is allocated.
+ */
+void handle_miss(cache_t *cache, uword_t addr, operation_t operation, byte_t *incoming_data,
+                 evicted_line_t *evicted_line)
+{
+    cache_stats_t stats = {0};
+    fill_line(cache, addr, operation, incoming_data, evicted_line, &stats);
+    dirty_eviction_count += stats.dirty_evictions;
+    clean_eviction_count += stats.clean_evictions;
 }
 /* STUDENT TO-DO:
  * Get 8 bytes from the cache and write it to dest.
@@ -285,10 +636,10 @@ void get_word_cache(cache_t *cache, uword_t addr, word_t *dest) {
     /* Your implementation */
     unsigned int block_size = cache -> B;
     byte_t *res = (byte_t*) dest;
-    cache_line_t *selected_line = get_line(cache, addr);
+    byte_t *selected_data = cache->data + get_line(cache, addr) * block_size;
     for (int i = 0; i < 8; i++) {
-        unsigned int offset = (addr + i) % block_size;
-        res[i] = selected_line -> data[offset];
+        unsigned int offset = (addr + i) & cache->off_mask;
+        res[i] = selected_data[offset];
     }
 }
 
@@ -300,23 +651,63 @@ void set_word_cache(cache_t *cache, uword_t addr, word_t val) {
     /* Your implementation */
     unsigned int block_size = cache -> B;
     byte_t *val_byte = (byte_t*) &val;
-    cache_line_t *selected_line = get_line(cache, addr);
+    byte_t *selected_data = cache->data + get_line(cache, addr) * block_size;
     for (int i = 0; i < 8; i++) {
-        unsigned int offset = (addr + i) % block_size;
-        selected_line -> data[offset] = val_byte[i];
+        unsigned int offset = (addr + i) & cache->off_mask;
+        selected_data[offset] = val_byte[i];
     }
 }
+
+/*
+ * The steps of one access, shared by access_data() and access_batch():
+ * the bodies of check_hit() and handle_miss(), with the victim cache
+ * between them, counted in *stats.
+ */
+static void access_one(cache_t *cache, uword_t addr, operation_t operation, cache_stats_t *stats)
+{
+    if (!hit_line(cache, addr, operation, stats) && !(cache->victim && victim_hit(cache, addr, operation))) {
+        evicted_line_t evicted = {.data = NULL};
+        fill_line(cache, addr, operation, NULL, &evicted, stats);
+    }
+}
+
 /*
  * Access data at memory address addr
  * If it is already in cache, increase hit_count
  * If it is not in cache, bring it in cache, increase miss count
  * Also increase eviction_count if a line is evicted
  *
- * Called by cache-runner; no need to modify it if you implement
- * check_hit() and handle_miss()
+ * Called by cache-runner. It takes the same steps as check_hit() and
+ * handle_miss(), through access_one().
  */
 void access_data(cache_t *cache, uword_t addr, operation_t operation)
 {
-    if(!check_hit(cache, addr, operation))
-        free(handle_miss(cache, addr, operation, NULL));
+    cache_stats_t stats = {0};
+    access_one(cache, addr, operation, &stats);
+    hit_count += stats.hits;
+    miss_count += stats.misses;
+    dirty_eviction_count += stats.dirty_evictions;
+    clean_eviction_count += stats.clean_evictions;
+}
+
+static void prefetch_set(cache_t *cache, uword_t addr) {
+    size_t first = ((addr >> cache->b_bits) & cache->set_mask) * cache->A;
+    __builtin_prefetch(cache->tags + first);
+    __builtin_prefetch(cache->valid + first);
+    __builtin_prefetch(cache->lru + first, 1);
+}
+
+/*
+ * The same steps as access_data(), counted in *out rather than the globals.
+ */
+void access_batch(cache_t *cache, const uword_t *addrs, const operation_t *ops, size_t n,
+                  cache_stats_t *out)
+{
+    for (size_t i = 0; i < n && i < BATCH_PREFETCH; i++)
+        prefetch_set(cache, addrs[i]);
+    for (size_t i = 0; i < n; i++) {
+        if (i + BATCH_PREFETCH < n)
+            prefetch_set(cache, addrs[i + BATCH_PREFETCH]);
+        access_one(cache, addrs[i], ops[i], out);
+    }
 }
\ No newline at end of file
@@ -14,6 +14,9 @@
  * May not be used, modified, or copied without permission.
  **************************************************************************/ 
 #include "cache.h"
+#include "stackdist.h"
+#include "sweep.h"
+#include "trace.h"
 #include <getopt.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -51,49 +54,72 @@ void printSummary(int hits, int misses, int dirty_evictions, int clean_evictions
 
 
 /*
- * replayTrace - replays the given trace file against the cache
+ * replayTrace - replays the given trace file against the cache, a batch
+ *               at a time, and adds the outcome to the counters
  */
 void replayTrace(cache_t *cache, char* trace_fn)
 {
-    char buf[1000];
-    uword_t addr=0;
-    unsigned int len=0;
-    FILE* trace_fp = fopen(trace_fn, "r");
+    // An M record is a read and then a write, so a batch can double.
+    static uword_t addrs[2 * TRACE_BATCH];
+    static operation_t ops[2 * TRACE_BATCH];
+    cache_stats_t stats = {0};
+    const trace_batch_t *batch;
+    trace_queue_t *queue = trace_queue_start(trace_fn);
 
-    if(!trace_fp){
-        fprintf(stderr, "%s: %s\n", trace_fn, strerror(errno));
-        exit(1);
-    }
-
-    while( fgets(buf, 1000, trace_fp) != NULL) {
-        if(buf[1]=='S' || buf[1]=='L' || buf[1]=='M') {
-            sscanf(buf+3, "%llx,%u", &addr, &len);
+    while ((batch = trace_queue_next(queue)) != NULL) {
+        const trace_rec_t *recs = batch->recs;
+        size_t n = 0;
+        for (size_t i = 0; i < batch->n; i++) {
+            uword_t addr = recs[i].addr;
 
             if( verbosity_cache)
-                printf("%c %llx,%u ", buf[1], addr, len);
+                printf("%c %llx,%u \n", recs[i].op, addr, recs[i].len);
 
-            switch (buf[1]) {
+            switch (recs[i].op) {
                 case 'S':
-                    access_data(cache, addr, WRITE);
+                    addrs[n] = addr;
+                    ops[n++] = WRITE;
                     break;
                 case 'L':
-                    access_data(cache, addr, READ);
+                    addrs[n] = addr;
+                    ops[n++] = READ;
                     break;
                 case 'M':
-                    access_data(cache, addr, READ);
-                    access_data(cache, addr, WRITE);
+                    addrs[n] = addr;
+                    ops[n++] = READ;
+                    addrs[n] = addr;
+                    ops[n++] = WRITE;
                     break;
                 default:
-                    printf("Bad trace operation: %c\n", buf[1]);
+                    printf("Bad trace operation: %c\n", recs[i].op);
 
             }
-
-            if ( verbosity_cache)
-                printf("\n");
         }
+        access_batch(cache, addrs, ops, n, &stats);
     }
 
-    fclose(trace_fp);
+    trace_queue_stop(queue);
+    hit_count += stats.hits;
+    miss_count += stats.misses;
+    dirty_eviction_count += stats.dirty_evictions;
+    clean_eviction_count += stats.clean_evictions;
+}
+
+/*
+ * parseList - reads a comma-separated list of numbers such as 1,2,4 into
+ *             vals and returns how many there were
+ */
+int parseList(char *arg, int *vals)
+{
+    int n = 0;
+    for (char *tok = strtok(arg, ","); tok; tok = strtok(NULL, ",")) {
+        if (n == SWEEP_MAX_VALUES) {
+            printf("At most %d values per list\n", SWEEP_MAX_VALUES);
+            exit(1);
+        }
+        vals[n++] = atoi(tok);
+    }
+    return n;
 }
 
 /*
@@ -101,17 +127,30 @@ void replayTrace(cache_t *cache, char* trace_fn)
  */
 void printUsage(char* argv[])
 {
-    printf("Usage: %s [-hv] -A <num> -B <num> -C <num> -t <file>\n", argv[0]);
+    printf("Usage: %s [-hv] -A <num> -B <num> -C <num> [-P <policy>] [-V <num>] [-j <num>] [-T <format>] -t <file>\n", argv[0]);
+    printf("       %s -S -B <num>[,<num>...] -t <file>\n", argv[0]);
     printf("Options:\n");
     printf("  -h         Print this help message.\n");
     printf("  -v         Optional verbose flag.\n");
     printf("  -A <num>   Number of lines per set.\n");
     printf("  -E <num>   Number of lines per set.\n");
     printf("  -b <num>   Number of block offset bits.\n");
+    printf("  -P <name>  Replacement policy: lru (default), plru, bitplru,\n");
+    printf("             srrip, brrip, fifo or random.\n");
+    printf("  -V <num>   Victim cache of <num> lines (1 to %d).\n", VICTIM_MAX);
+    printf("  -j <num>   Worker threads for a sweep (default: one per CPU).\n");
+    printf("  -S         Print the LRU miss-ratio curve of fully associative\n");
+    printf("             caches of every capacity, for each block size given.\n");
+    printf("  -T <name>  Trace format: text (default) or binary, as written\n");
+    printf("             by trace-convert.\n");
     printf("  -t <file>  Trace file.\n");
+    printf("\nA comma-separated list for any of -A, -B and -C, such as -A 1,2,4,\n");
+    printf("sweeps every combination in one pass over the trace and prints CSV.\n");
     printf("\nExamples:\n");
     printf("  linux>  %s -A 1 -B 16 -C 64 -t traces/yi.trace\n", argv[0]);
     printf("  linux>  %s -v -A 2 -B 16 -C 256 -t traces/yi.trace\n", argv[0]);
+    printf("  linux>  %s -A 1,2,4,8 -B 16,32 -C 256,1024,4096 -t traces/yi.trace\n", argv[0]);
+    printf("  linux>  %s -S -B 16,64 -t traces/yi.trace\n", argv[0]);
     exit(0);
 }
 
@@ -120,19 +159,57 @@ void printUsage(char* argv[])
  */
 int main(int argc, char* argv[])
 {
-    int A = -1, B = -1, C = -1;
+    int A = -1, B = -1, C = -1, V = 0;
+    int As[SWEEP_MAX_VALUES], Bs[SWEEP_MAX_VALUES], Cs[SWEEP_MAX_VALUES];
+    int nA = 0, nB = 0, nC = 0;
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    bool stack_distances = false;
     char c;
-    while( (c=getopt(argc,argv,"A:B:C:t:vh")) != -1){
+    while( (c=getopt(argc,argv,"A:B:C:P:V:j:ST:t:vh")) != -1){
         switch(c){
         case 'A':
-            A = atoi(optarg);
+            nA = parseList(optarg, As);
+            A = nA > 0 ? As[0] : -1;
             break;
         case 'B':
-            B = atoi(optarg);
+            nB = parseList(optarg, Bs);
+            B = nB > 0 ? Bs[0] : -1;
             break;
         case 'C':
-            C = atoi(optarg);
+            nC = parseList(optarg, Cs);
+            C = nC > 0 ? Cs[0] : -1;
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        case 'S':
+            stack_distances = true;
+            break;
+        case 'P': {
+            int policy = parse_repl_policy(optarg);
+            if (policy < 0) {
+                printf("%s: Unknown replacement policy %s\n", argv[0], optarg);
+                exit(1);
+            }
+            repl_policy = policy;
+            break;
+        }
+        case 'V':
+            V = atoi(optarg);
+            if (V < 1 || V > VICTIM_MAX) {
+                printf("%s: Victim cache needs 1 to %d lines\n", argv[0], VICTIM_MAX);
+                exit(1);
+            }
+            break;
+        case 'T': {
+            int format = parse_trace_format(optarg);
+            if (format < 0) {
+                printf("%s: Unknown trace format %s\n", argv[0], optarg);
+                exit(1);
+            }
+            trace_format = format;
             break;
+        }
         case 't':
             trace_file = optarg;
             break;
@@ -148,6 +225,16 @@ int main(int argc, char* argv[])
         }
     }
 
+    /* Stack distances need only block sizes; capacity and associativity vary */
+    if (stack_distances) {
+        if (B == -1 || trace_file == NULL) {
+            printf("%s: -S needs -B and -t\n", argv[0]);
+            exit(1);
+        }
+        run_stackdist(trace_file, Bs, nB, stdout);
+        return 0;
+    }
+
     /* Make sure that all required command line args were specified */
     if (A == -1 || B == -1 || C == -1 || trace_file == NULL) {
         printf("%s: Missing required command line argument\n", argv[0]);
@@ -155,8 +242,25 @@ int main(int argc, char* argv[])
         exit(1);
     }
 
+    /* More than one value for A, B or C asks for a sweep */
+    if (nA > 1 || nB > 1 || nC > 1) {
+        if (V) {
+            printf("%s: A sweep cannot have a victim cache\n", argv[0]);
+            exit(1);
+        }
+        run_sweep(trace_file, As, nA, Bs, nB, Cs, nC, threads > 0 ? threads : 1, stdout);
+        return 0;
+    }
+
+    if (!repl_policy_supported(repl_policy, A)) {
+        printf("%s: Policy %s does not support %d lines per set\n", argv[0], repl_policy_name(repl_policy), A);
+        exit(1);
+    }
+
     /* Initialize cache */
     cache_t *cache = create_cache(A, B, C, 0);
+    if (V)
+        cache_add_victim(cache, V);
 
 #ifdef DEBUG_ON
     printf("DEBUG: A:%u B:%u C:%u trace:%s\n", A, B, C, trace_file);
@@ -165,10 +269,15 @@ int main(int argc, char* argv[])
 
     replayTrace(cache, trace_file);
 
-    /* Free allocated memory */
-    free_cache(cache);
-
     /* Output the hit and miss statistics for the autograder */
     printSummary(hit_count, miss_count, dirty_eviction_count, clean_eviction_count);
+    if (cache->victim) {
+        victim_cache_t *v = cache->victim;
+        printf("victim hits:%lu misses:%lu hit rate:%.2f%%\n", v->hits, v->misses,
+               v->hits + v->misses ? 100.0 * v->hits / (v->hits + v->misses) : 0.0);
+    }
+
+    /* Free allocated memory */
+    free_cache(cache);
     return 0;
 }
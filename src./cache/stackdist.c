@@ -0,0 +1,209 @@
+/**************************************************************************
+ * C S 429 system emulator
+ *
+ * stackdist.c - Module for LRU stack distance (Mattson) analysis.
+ *
+ * Each block keeps the time of its last access, and a Fenwick tree over
+ * times holds a 1 at every such time. The distance of an access is then
+ * the number of 1s after its block's last access, a prefix-sum difference.
+ * When the times run off the end of the tree, the live ones are renumbered
+ * 0..M-1 in order and the tree is rebuilt at twice that size, so the tree
+ * stays O(M) for M blocks however long the trace is.
+ *
+ * Copyright (c) 2023.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "stackdist.h"
+#include "trace.h"
+
+#define MIN_TREE 65536
+#define MIN_TABLE 1024
+
+typedef struct time_slot {
+    uint64_t last;
+    uint64_t slot;
+} time_slot_t;
+
+stackdist_t *stackdist_create(unsigned int B) {
+    stackdist_t *sd = calloc(1, sizeof(stackdist_t));
+    while ((1U << sd->b_bits) < B)
+        sd->b_bits++;
+    sd->table_size = MIN_TABLE;
+    sd->keys = calloc(sd->table_size, sizeof(uword_t));
+    sd->last = calloc(sd->table_size, sizeof(uint64_t));
+    sd->used = calloc(sd->table_size, sizeof(bool));
+    sd->tree_size = MIN_TREE;
+    sd->tree = calloc(sd->tree_size + 1, sizeof(unsigned int));
+    sd->hist_size = MIN_TABLE;
+    sd->hist = calloc(sd->hist_size, sizeof(uint64_t));
+    return sd;
+}
+
+void stackdist_free(stackdist_t *sd) {
+    free(sd->keys);
+    free(sd->last);
+    free(sd->used);
+    free(sd->tree);
+    free(sd->hist);
+    free(sd);
+}
+
+// Add v at time i.
+static void tree_add(stackdist_t *sd, uint64_t i, int v) {
+    for (i++; i <= sd->tree_size; i += i & -i)
+        sd->tree[i] += v;
+}
+
+// Sum over times [0, i).
+static uint64_t tree_sum(stackdist_t *sd, uint64_t i) {
+    uint64_t sum = 0;
+    for (; i > 0; i -= i & -i)
+        sum += sd->tree[i];
+    return sum;
+}
+
+// The slot that holds block, or the empty slot where it belongs.
+static uint64_t table_slot(stackdist_t *sd, uword_t block) {
+    uint64_t mask = sd->table_size - 1;
+    uint64_t i = (block * 0x9e3779b97f4a7c15ULL) >> 20 & mask;
+    while (sd->used[i] && sd->keys[i] != block)
+        i = (i + 1) & mask;
+    return i;
+}
+
+static void table_grow(stackdist_t *sd) {
+    uword_t *keys = sd->keys;
+    uint64_t *last = sd->last;
+    bool *used = sd->used;
+    uint64_t old_size = sd->table_size;
+    sd->table_size *= 2;
+    sd->keys = calloc(sd->table_size, sizeof(uword_t));
+    sd->last = calloc(sd->table_size, sizeof(uint64_t));
+    sd->used = calloc(sd->table_size, sizeof(bool));
+    for (uint64_t i = 0; i < old_size; i++) {
+        if (used[i]) {
+            uint64_t j = table_slot(sd, keys[i]);
+            sd->used[j] = true;
+            sd->keys[j] = keys[i];
+            sd->last[j] = last[i];
+        }
+    }
+    free(keys);
+    free(last);
+    free(used);
+}
+
+static int by_time(const void *a, const void *b) {
+    uint64_t x = ((const time_slot_t *) a)->last, y = ((const time_slot_t *) b)->last;
+    return x < y ? -1 : x > y;
+}
+
+// Renumber the live times 0..M-1, keeping their order, and rebuild the tree.
+static void compact(stackdist_t *sd) {
+    time_slot_t *live = malloc(sd->num_blocks * sizeof(time_slot_t));
+    uint64_t n = 0;
+    for (uint64_t i = 0; i < sd->table_size; i++) {
+        if (sd->used[i]) {
+            live[n].last = sd->last[i];
+            live[n].slot = i;
+            n++;
+        }
+    }
+    qsort(live, n, sizeof(time_slot_t), by_time);
+    for (uint64_t i = 0; i < n; i++)
+        sd->last[live[i].slot] = i;
+    free(live);
+
+    free(sd->tree);
+    sd->tree_size = 2 * n > MIN_TREE ? 2 * n : MIN_TREE;
+    sd->tree = calloc(sd->tree_size + 1, sizeof(unsigned int));
+    // A tree of n 1s, built in linear time.
+    for (uint64_t i = 1; i <= n; i++)
+        sd->tree[i] += 1;
+    for (uint64_t i = 1; i <= sd->tree_size; i++) {
+        uint64_t parent = i + (i & -i);
+        if (parent <= sd->tree_size)
+            sd->tree[parent] += sd->tree[i];
+    }
+    sd->now = n;
+}
+
+void stackdist_access(stackdist_t *sd, uword_t addr) {
+    uword_t block = addr >> sd->b_bits;
+    if (sd->now == sd->tree_size)
+        compact(sd);
+    if (2 * (sd->num_blocks + 1) > sd->table_size)
+        table_grow(sd);
+    uint64_t slot = table_slot(sd, block);
+    if (sd->used[slot]) {
+        uint64_t prev = sd->last[slot];
+        uint64_t d = tree_sum(sd, sd->now) - tree_sum(sd, prev + 1);
+        if (d >= sd->hist_size) {
+            uint64_t old_size = sd->hist_size;
+            while (d >= sd->hist_size)
+                sd->hist_size *= 2;
+            sd->hist = realloc(sd->hist, sd->hist_size * sizeof(uint64_t));
+            memset(sd->hist + old_size, 0, (sd->hist_size - old_size) * sizeof(uint64_t));
+        }
+        sd->hist[d]++;
+        tree_add(sd, prev, -1);
+    }
+    else {
+        sd->used[slot] = true;
+        sd->keys[slot] = block;
+        sd->num_blocks++;
+    }
+    tree_add(sd, sd->now, 1);
+    sd->last[slot] = sd->now++;
+    sd->accesses++;
+}
+
+void stackdist_print(stackdist_t *sd, FILE *out) {
+    unsigned int B = 1U << sd->b_bits;
+    // k lines miss every access with distance k or more, and the cold ones.
+    uint64_t misses = sd->accesses;
+    for (uint64_t k = 1; k <= sd->hist_size; k++) {
+        misses -= sd->hist[k - 1];
+        if (k == 1 || sd->hist[k - 1])
+            fprintf(out, "%u,%lu,%lu,%lu,%.6f\n", B, k, k * B, misses,
+                    sd->accesses ? (double) misses / sd->accesses : 0.0);
+    }
+}
+
+void run_stackdist(const char *trace_fn, const int *Bs, int n, FILE *out) {
+    stackdist_t **sds = malloc(n * sizeof(stackdist_t *));
+    int num = 0;
+    for (int i = 0; i < n; i++) {
+        if (Bs[i] < 1 || (Bs[i] & (Bs[i] - 1))) {
+            fprintf(stderr, "Skipping B=%d, not a power of two\n", Bs[i]);
+            continue;
+        }
+        sds[num++] = stackdist_create(Bs[i]);
+    }
+
+    static trace_rec_t recs[TRACE_BATCH];
+    size_t len;
+    trace_t *trace = trace_open(trace_fn);
+    while ((len = trace_read(trace, recs, TRACE_BATCH)) > 0) {
+        for (int s = 0; s < num; s++) {
+            for (size_t i = 0; i < len; i++) {
+                stackdist_access(sds[s], recs[i].addr);
+                // M is a read and then a write of the same address.
+                if (recs[i].op == 'M')
+                    stackdist_access(sds[s], recs[i].addr);
+            }
+        }
+    }
+    trace_close(trace);
+
+    fprintf(out, "B,lines,capacity,misses,miss_ratio\n");
+    for (int s = 0; s < num; s++) {
+        stackdist_print(sds[s], out);
+        stackdist_free(sds[s]);
+    }
+    free(sds);
+}
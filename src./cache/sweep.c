@@ -0,0 +1,153 @@
+/**************************************************************************
+ * C S 429 system emulator
+ *
+ * sweep.c - Module for simulating many cache geometries over one pass of
+ *     a trace.
+ *
+ * The main thread parses the trace into two chunks of accesses in turn.
+ * While the workers replay one chunk, it fills the other; a barrier ends
+ * each round. A worker owns a fixed subset of the configurations, and
+ * access_batch() counts into each configuration rather than the shared
+ * counters (next_lru is per thread), so workers never synchronise with
+ * each other mid-chunk.
+ *
+ * Copyright (c) 2023.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "sweep.h"
+#include "trace.h"
+
+typedef struct sweep_state {
+    uword_t *addrs[2];
+    operation_t *ops[2];
+    size_t lens[2];         /* Accesses in each chunk */
+    sweep_config_t *configs;
+    int num_configs;
+    int num_threads;
+    pthread_barrier_t round;
+} sweep_state_t;
+
+typedef struct sweep_worker {
+    sweep_state_t *state;
+    int id;
+} sweep_worker_t;
+
+static bool power_of_two(int x) {
+    return x > 0 && (x & (x - 1)) == 0;
+}
+
+bool sweep_valid(int A, int B, int C) {
+    if (A < 1 || !power_of_two(B) || C < A * B || C % (A * B))
+        return false;
+    return power_of_two(C / (A * B)) && repl_policy_supported(repl_policy, A);
+}
+
+/*
+ * Read the next chunk of the trace into accesses for access_batch().
+ * Returns how many there are, 0 at the end of the trace.
+ */
+static size_t sweep_fill(trace_t *trace, trace_rec_t *recs, uword_t *addrs, operation_t *ops) {
+    size_t len = trace_read(trace, recs, SWEEP_CHUNK), n = 0;
+    for (size_t i = 0; i < len; i++) {
+        // M is a read and then a write of the same address.
+        addrs[n] = recs[i].addr;
+        ops[n++] = recs[i].op == 'S' ? WRITE : READ;
+        if (recs[i].op == 'M') {
+            addrs[n] = recs[i].addr;
+            ops[n++] = WRITE;
+        }
+    }
+    return n;
+}
+
+static void *sweep_thread(void *arg) {
+    sweep_worker_t *w = arg;
+    sweep_state_t *s = w->state;
+    pthread_barrier_wait(&s->round);
+    for (int r = 0; ; r ^= 1) {
+        for (int i = w->id; i < s->num_configs; i += s->num_threads)
+            access_batch(s->configs[i].cache, s->addrs[r], s->ops[r], s->lens[r], &s->configs[i].stats);
+        pthread_barrier_wait(&s->round);
+        if (!s->lens[r ^ 1])
+            break;
+    }
+    return NULL;
+}
+
+void run_sweep(const char *trace_fn, const int *As, int nA, const int *Bs, int nB,
+               const int *Cs, int nC, int threads, FILE *out) {
+    sweep_state_t s;
+    s.configs = malloc((size_t) nA * nB * nC * sizeof(sweep_config_t));
+    s.num_configs = 0;
+    for (int c = 0; c < nC; c++) {
+        for (int b = 0; b < nB; b++) {
+            for (int a = 0; a < nA; a++) {
+                if (!sweep_valid(As[a], Bs[b], Cs[c])) {
+                    fprintf(stderr, "Skipping A=%d B=%d C=%d, not a valid cache\n", As[a], Bs[b], Cs[c]);
+                    continue;
+                }
+                sweep_config_t *cfg = &s.configs[s.num_configs++];
+                cfg->A = As[a];
+                cfg->B = Bs[b];
+                cfg->C = Cs[c];
+                cfg->cache = create_cache(As[a], Bs[b], Cs[c], 0);
+                cfg->stats = (cache_stats_t) {0};
+            }
+        }
+    }
+    s.num_threads = threads < s.num_configs ? threads : s.num_configs;
+    if (s.num_threads < 1)
+        s.num_threads = 1;
+    trace_rec_t *recs = malloc(SWEEP_CHUNK * sizeof(trace_rec_t));
+    for (int r = 0; r < 2; r++) {
+        s.addrs[r] = malloc(2 * SWEEP_CHUNK * sizeof(uword_t));
+        s.ops[r] = malloc(2 * SWEEP_CHUNK * sizeof(operation_t));
+    }
+    pthread_barrier_init(&s.round, NULL, s.num_threads + 1);
+
+    pthread_t *tids = malloc(s.num_threads * sizeof(pthread_t));
+    sweep_worker_t *workers = malloc(s.num_threads * sizeof(sweep_worker_t));
+    for (int i = 0; i < s.num_threads; i++) {
+        workers[i].state = &s;
+        workers[i].id = i;
+        pthread_create(&tids[i], NULL, sweep_thread, &workers[i]);
+    }
+
+    // Fill the buffer the workers will use next round while they run this one.
+    trace_t *trace = trace_open(trace_fn);
+    s.lens[0] = sweep_fill(trace, recs, s.addrs[0], s.ops[0]);
+    pthread_barrier_wait(&s.round);
+    for (int r = 0; ; r ^= 1) {
+        s.lens[r ^ 1] = sweep_fill(trace, recs, s.addrs[r ^ 1], s.ops[r ^ 1]);
+        pthread_barrier_wait(&s.round);
+        if (!s.lens[r ^ 1])
+            break;
+    }
+    trace_close(trace);
+    for (int i = 0; i < s.num_threads; i++)
+        pthread_join(tids[i], NULL);
+
+    fprintf(out, "A,B,C,hits,misses,dirty_evictions,clean_evictions,miss_rate\n");
+    for (int i = 0; i < s.num_configs; i++) {
+        sweep_config_t *cfg = &s.configs[i];
+        cache_stats_t *st = &cfg->stats;
+        unsigned long accesses = st->hits + st->misses;
+        fprintf(out, "%d,%d,%d,%lu,%lu,%lu,%lu,%.6f\n", cfg->A, cfg->B, cfg->C, st->hits, st->misses,
+                st->dirty_evictions, st->clean_evictions, accesses ? (double) st->misses / accesses : 0.0);
+        free_cache(cfg->cache);
+    }
+
+    pthread_barrier_destroy(&s.round);
+    free(tids);
+    free(workers);
+    free(recs);
+    for (int r = 0; r < 2; r++) {
+        free(s.addrs[r]);
+        free(s.ops[r]);
+    }
+    free(s.configs);
+}
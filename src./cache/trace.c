@@ -0,0 +1,460 @@
+/**************************************************************************
+ * C S 429 system emulator
+ *
+ * trace.c - Module for reading Valgrind memory traces into batches of
+ *     records.
+ *
+ * A line is " L addr,len", " S addr,len" or " M addr,len", with the
+ * address in hex; lines with anything else in their second column (such
+ * as "I" instruction fetches) are skipped. The scanner accepts what the
+ * sscanf("%llx,%u") it replaces did: leading blanks and an optional 0x.
+ *
+ * Binary traces are laid out as trace.h describes. Their compression is a
+ * small LZ77 in the style of LZ4: a block is a run of sequences, each a
+ * token byte (literal count in the high nibble, match length less 4 in the
+ * low, 15 meaning more count follows in bytes of up to 255), the literals,
+ * then a 2-byte little-endian offset back into the output and any extra
+ * match-length bytes. The last sequence stops after its literals.
+ *
+ * Copyright (c) 2023.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "trace.h"
+
+#define TRACE_VERSION 1
+#define LZ_HASH_BITS 12
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+
+trace_format_t trace_format = TRACE_TEXT;
+
+int parse_trace_format(const char *name) {
+    if (!strcmp(name, "text"))
+        return TRACE_TEXT;
+    if (!strcmp(name, "binary"))
+        return TRACE_BINARY;
+    return -1;
+}
+
+trace_t *trace_open(const char *name) {
+    trace_t *trace = calloc(1, sizeof(trace_t));
+    trace->format = trace_format;
+    struct stat st;
+    int fd = open(name, O_RDONLY);
+    if (fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            trace->map = map;
+            trace->map_len = st.st_size;
+            trace->pos = map;
+        }
+    }
+    if (fd >= 0)
+        close(fd);
+    if (trace->format == TRACE_BINARY) {
+        // Blocks are decoded in place, so a binary trace has to be mapped.
+        if (!trace->map) {
+            fprintf(stderr, "%s: %s\n", name, fd < 0 ? strerror(errno) : "not a regular, non-empty file");
+            exit(1);
+        }
+        trace_file_hdr_t hdr;
+        if (trace->map_len < sizeof(hdr) || memcmp(trace->map, TRACE_MAGIC, sizeof(hdr.magic))) {
+            fprintf(stderr, "%s: not a binary trace\n", name);
+            exit(1);
+        }
+        memcpy(&hdr, trace->map, sizeof(hdr));
+        if (hdr.version != TRACE_VERSION) {
+            fprintf(stderr, "%s: binary trace version %u, expected %u\n", name, hdr.version, TRACE_VERSION);
+            exit(1);
+        }
+        trace->pos += sizeof(hdr);
+        return trace;
+    }
+    if (trace->map)
+        return trace;
+    trace->fp = fopen(name, "r");
+    if (!trace->fp) {
+        fprintf(stderr, "%s: %s\n", name, strerror(errno));
+        exit(1);
+    }
+    return trace;
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+/*
+ * Scan the line [p, end) into rec. Returns false for a line that is not a
+ * data access. As with sscanf, a malformed address or length reads as 0.
+ */
+static bool scan_line(const char *p, const char *end, trace_rec_t *rec) {
+    if (end - p < 2 || (p[1] != 'L' && p[1] != 'S' && p[1] != 'M'))
+        return false;
+    rec->op = p[1];
+    rec->addr = 0;
+    rec->len = 0;
+    p += 3;
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X') && hex_digit(p[2]) >= 0)
+        p += 2;
+    const char *digits = p;
+    int v;
+    for (; p < end && (v = hex_digit(*p)) >= 0; p++)
+        rec->addr = rec->addr << 4 | v;
+    if (p == digits || p >= end || *p != ',')
+        return true;
+    for (p++; p < end && *p >= '0' && *p <= '9'; p++)
+        rec->len = rec->len * 10 + (*p - '0');
+    return true;
+}
+
+static void corrupt(void) {
+    fprintf(stderr, "Binary trace is corrupt\n");
+    exit(1);
+}
+
+// Expand the LZ block [in, end) into out, which has room for exactly len.
+static void lz_decompress(const uint8_t *in, const uint8_t *end, uint8_t *out, size_t len) {
+    uint8_t *op = out, *oend = out + len;
+    while (in < end) {
+        unsigned int token = *in++;
+        size_t lits = token >> 4, match = token & 15;
+        if (lits == 15) {
+            unsigned int b;
+            do {
+                if (in == end)
+                    corrupt();
+                lits += b = *in++;
+            } while (b == 255);
+        }
+        if ((size_t) (end - in) < lits || (size_t) (oend - op) < lits)
+            corrupt();
+        memcpy(op, in, lits);
+        op += lits;
+        in += lits;
+        if (in == end)
+            break;
+        if (end - in < 2)
+            corrupt();
+        size_t offset = in[0] | in[1] << 8;
+        in += 2;
+        if (match == 15) {
+            unsigned int b;
+            do {
+                if (in == end)
+                    corrupt();
+                match += b = *in++;
+            } while (b == 255);
+        }
+        match += LZ_MIN_MATCH;
+        if (!offset || offset > (size_t) (op - out) || (size_t) (oend - op) < match)
+            corrupt();
+        // The match may overlap what it copies, so go a byte at a time.
+        const uint8_t *from = op - offset;
+        while (match--)
+            *op++ = *from++;
+    }
+    if (op != oend)
+        corrupt();
+}
+
+// Move to the next block. Returns false at the end of the trace.
+static bool next_block(trace_t *trace) {
+    const char *end = trace->map + trace->map_len;
+    trace_block_hdr_t hdr;
+    if (trace->pos == end)
+        return false;
+    if ((size_t) (end - trace->pos) < sizeof(hdr))
+        corrupt();
+    memcpy(&hdr, trace->pos, sizeof(hdr));
+    const uint8_t *stored = (const uint8_t *) trace->pos + sizeof(hdr);
+    if ((size_t) (end - (const char *) stored) < hdr.stored_len)
+        corrupt();
+    trace->pos = (const char *) stored + hdr.stored_len;
+    if (hdr.flags & TRACE_BLOCK_LZ) {
+        if (trace->unpacked_len < hdr.raw_len) {
+            trace->unpacked_len = hdr.raw_len;
+            trace->unpacked = realloc(trace->unpacked, hdr.raw_len);
+        }
+        lz_decompress(stored, stored + hdr.stored_len, trace->unpacked, hdr.raw_len);
+        stored = trace->unpacked;
+    }
+    else if (hdr.raw_len != hdr.stored_len)
+        corrupt();
+    trace->rec_pos = stored;
+    trace->rec_end = stored + hdr.raw_len;
+    trace->rec_left = hdr.records;
+    trace->prev_addr = 0;
+    return true;
+}
+
+static uint64_t get_varint(const uint8_t **p, const uint8_t *end) {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (*p == end)
+            corrupt();
+        uint8_t b = *(*p)++;
+        v |= (uint64_t) (b & 127) << shift;
+        if (!(b & 128))
+            return v;
+    }
+    corrupt();
+    return 0;
+}
+
+static size_t read_binary(trace_t *trace, trace_rec_t *recs, size_t max) {
+    static const char ops[4] = {'L', 'S', 'M', 0};
+    size_t n = 0;
+    while (n < max) {
+        if (!trace->rec_left) {
+            if (!next_block(trace))
+                break;
+            continue;
+        }
+        const uint8_t *p = trace->rec_pos, *end = trace->rec_end;
+        uword_t addr = trace->prev_addr;
+        size_t count = trace->rec_left < max - n ? trace->rec_left : max - n;
+        for (size_t i = 0; i < count; i++) {
+            if (p == end || !ops[*p & 3])
+                corrupt();
+            trace_rec_t *rec = &recs[n++];
+            unsigned int code = *p >> 2 & 7;
+            rec->op = ops[*p++ & 3];
+            rec->len = code == TRACE_LEN_VARINT ? (unsigned int) get_varint(&p, end) : 1U << code;
+            uint64_t zz = get_varint(&p, end);
+            addr += (zz >> 1) ^ -(zz & 1);
+            rec->addr = addr;
+        }
+        trace->rec_pos = p;
+        trace->rec_left -= count;
+        trace->prev_addr = addr;
+        if (!trace->rec_left && p != end)
+            corrupt();
+    }
+    return n;
+}
+
+size_t trace_read(trace_t *trace, trace_rec_t *recs, size_t max) {
+    size_t n = 0;
+    if (trace->format == TRACE_BINARY)
+        return read_binary(trace, recs, max);
+    if (trace->map) {
+        const char *end = trace->map + trace->map_len;
+        while (n < max && trace->pos < end) {
+            const char *eol = memchr(trace->pos, '\n', end - trace->pos);
+            if (!eol)
+                eol = end;
+            n += scan_line(trace->pos, eol, &recs[n]);
+            trace->pos = eol + (eol < end);
+        }
+        return n;
+    }
+    while (n < max && fgets(trace->buf, sizeof(trace->buf), trace->fp) != NULL)
+        n += scan_line(trace->buf, trace->buf + strlen(trace->buf), &recs[n]);
+    return n;
+}
+
+void trace_close(trace_t *trace) {
+    if (trace->map)
+        munmap((void *) trace->map, trace->map_len);
+    else
+        fclose(trace->fp);
+    free(trace->unpacked);
+    free(trace);
+}
+
+trace_writer_t *trace_writer_open(const char *name, bool compress) {
+    trace_writer_t *w = calloc(1, sizeof(trace_writer_t));
+    w->fp = fopen(name, "wb");
+    if (!w->fp) {
+        fprintf(stderr, "%s: %s\n", name, strerror(errno));
+        exit(1);
+    }
+    w->compress = compress;
+    trace_file_hdr_t hdr = {.version = TRACE_VERSION};
+    memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+    fwrite(&hdr, sizeof(hdr), 1, w->fp);
+    return w;
+}
+
+static uint8_t *put_varint(uint8_t *p, uint64_t v) {
+    while (v >= 128) {
+        *p++ = (v & 127) | 128;
+        v >>= 7;
+    }
+    *p++ = v;
+    return p;
+}
+
+// Append count bytes of 255 and a remainder to *op, as the LZ token extensions are.
+static bool lz_put_count(uint8_t **op, const uint8_t *oend, size_t count) {
+    for (; count >= 255; count -= 255) {
+        if (*op == oend)
+            return false;
+        *(*op)++ = 255;
+    }
+    if (*op == oend)
+        return false;
+    *(*op)++ = count;
+    return true;
+}
+
+// Emit lits literals and, if match is nonzero, a match. Returns false if out of room.
+static bool lz_put_sequence(uint8_t **op, const uint8_t *oend, const uint8_t *lit, size_t lits,
+                            size_t offset, size_t match) {
+    if (*op == oend)
+        return false;
+    size_t m = match ? match - LZ_MIN_MATCH : 0;
+    *(*op)++ = (lits < 15 ? lits : 15) << 4 | (m < 15 ? m : 15);
+    if (lits >= 15 && !lz_put_count(op, oend, lits - 15))
+        return false;
+    if ((size_t) (oend - *op) < lits)
+        return false;
+    memcpy(*op, lit, lits);
+    *op += lits;
+    if (!match)
+        return true;
+    if (oend - *op < 2)
+        return false;
+    *(*op)++ = offset & 255;
+    *(*op)++ = offset >> 8;
+    return m < 15 || lz_put_count(op, oend, m - 15);
+}
+
+/*
+ * Compress [in, in + len) into out. Returns the compressed length, or 0 if
+ * it would not be shorter than limit bytes.
+ */
+static size_t lz_compress(const uint8_t *in, size_t len, uint8_t *out, size_t limit) {
+    uint32_t table[1 << LZ_HASH_BITS];
+    memset(table, 0xff, sizeof(table));
+    uint8_t *op = out, *oend = out + limit;
+    size_t anchor = 0, i = 0;
+    while (i + LZ_MIN_MATCH <= len) {
+        uint32_t seq;
+        memcpy(&seq, in + i, sizeof(seq));
+        uint32_t h = seq * 2654435761U >> (32 - LZ_HASH_BITS);
+        uint32_t cand = table[h];
+        table[h] = i;
+        if (cand == UINT32_MAX || i - cand > LZ_MAX_OFFSET || memcmp(in + cand, in + i, LZ_MIN_MATCH)) {
+            i++;
+            continue;
+        }
+        size_t match = LZ_MIN_MATCH;
+        while (i + match < len && in[cand + match] == in[i + match])
+            match++;
+        if (!lz_put_sequence(&op, oend, in + anchor, i - anchor, i - cand, match))
+            return 0;
+        i += match;
+        anchor = i;
+    }
+    if (!lz_put_sequence(&op, oend, in + anchor, len - anchor, 0, 0) || op == oend)
+        return 0;
+    return op - out;
+}
+
+static void write_block(trace_writer_t *w) {
+    uint8_t *p = w->raw;
+    uword_t prev = 0;
+    for (size_t i = 0; i < w->num_pending; i++) {
+        const trace_rec_t *rec = &w->pending[i];
+        unsigned int op = rec->op == 'S' ? 1 : rec->op == 'M' ? 2 : 0;
+        unsigned int code = TRACE_LEN_VARINT;
+        if (rec->len && !(rec->len & (rec->len - 1)) && rec->len < 1U << TRACE_LEN_VARINT)
+            code = __builtin_ctz(rec->len);
+        *p++ = op | code << 2;
+        if (code == TRACE_LEN_VARINT)
+            p = put_varint(p, rec->len);
+        int64_t delta = (int64_t) (rec->addr - prev);
+        p = put_varint(p, (uint64_t) delta << 1 ^ (uint64_t) (delta >> 63));
+        prev = rec->addr;
+    }
+    trace_block_hdr_t hdr = {.records = w->num_pending, .raw_len = p - w->raw};
+    const uint8_t *stored = w->raw;
+    hdr.stored_len = hdr.raw_len;
+    size_t packed;
+    if (w->compress && (packed = lz_compress(w->raw, hdr.raw_len, w->packed, hdr.raw_len)) > 0) {
+        hdr.flags = TRACE_BLOCK_LZ;
+        hdr.stored_len = packed;
+        stored = w->packed;
+    }
+    fwrite(&hdr, sizeof(hdr), 1, w->fp);
+    fwrite(stored, 1, hdr.stored_len, w->fp);
+    w->num_pending = 0;
+}
+
+void trace_write(trace_writer_t *w, const trace_rec_t *recs, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        w->pending[w->num_pending++] = recs[i];
+        if (w->num_pending == TRACE_BATCH)
+            write_block(w);
+    }
+}
+
+void trace_writer_close(trace_writer_t *w) {
+    if (w->num_pending)
+        write_block(w);
+    fclose(w->fp);
+    free(w);
+}
+
+static void *trace_reader(void *arg) {
+    trace_queue_t *q = arg;
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    for (;;) {
+        // Wait for the consumer to give back a slot.
+        while (tail - atomic_load_explicit(&q->head, memory_order_acquire) == TRACE_QUEUE)
+            sched_yield();
+        trace_batch_t *batch = &q->slots[tail % TRACE_QUEUE];
+        batch->n = trace_read(q->trace, batch->recs, TRACE_BATCH);
+        atomic_store_explicit(&q->tail, ++tail, memory_order_release);
+        if (!batch->n)
+            return NULL;
+    }
+}
+
+trace_queue_t *trace_queue_start(const char *name) {
+    trace_queue_t *q = malloc(sizeof(trace_queue_t));
+    q->trace = trace_open(name);
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    q->holding = false;
+    pthread_create(&q->reader, NULL, trace_reader, q);
+    return q;
+}
+
+const trace_batch_t *trace_queue_next(trace_queue_t *q) {
+    size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    if (q->holding)
+        atomic_store_explicit(&q->head, ++head, memory_order_release);
+    while (atomic_load_explicit(&q->tail, memory_order_acquire) == head)
+        sched_yield();
+    const trace_batch_t *batch = &q->slots[head % TRACE_QUEUE];
+    q->holding = batch->n > 0;
+    return batch->n ? batch : NULL;
+}
+
+void trace_queue_stop(trace_queue_t *q) {
+    pthread_join(q->reader, NULL);
+    trace_close(q->trace);
+    free(q);
+}
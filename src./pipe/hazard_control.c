@@ -16,6 +16,7 @@
 
 extern machine_t guest;
 extern mem_status_t dmem_status;
+extern mem_status_t imem_status;
 
 /* Use this method to actually bubble/stall a pipeline stage.
  * Call it in handle_hazards(). Do not modify this code. */
@@ -85,8 +86,17 @@ comb_logic_t handle_hazards(opcode_t D_opcode, uint8_t D_src1, uint8_t D_src2,
     /* Students: Change this code */
 
 
+    // A cache miss is still in flight: hold everything up to and including
+    // the memory stage, and send a bubble down to writeback
+    if(dmem_status == IN_FLIGHT){
+        pipe_control_stage(S_FETCH, false, true);
+        pipe_control_stage(S_DECODE, false, true);
+        pipe_control_stage(S_EXECUTE, false, true);
+        pipe_control_stage(S_MEMORY, false, true);
+        pipe_control_stage(S_WBACK, true, false);
+    }
     // Check for return hazard
-    if(check_ret_hazard(D_opcode)){
+    else if(check_ret_hazard(D_opcode)){
            // Stall pipeline by flushing fetch and decode stages
         // Set execute stage to stop and wait for W stage to complete
         pipe_control_stage(S_FETCH, false, false);
@@ -113,8 +123,17 @@ comb_logic_t handle_hazards(opcode_t D_opcode, uint8_t D_src1, uint8_t D_src2,
         pipe_control_stage(S_EXECUTE, true, false);
         pipe_control_stage(S_MEMORY, false, false);
         pipe_control_stage(S_WBACK, false, false);
-
-}else {
+    }
+    // An instruction cache miss is in flight: hold fetch and send a bubble
+    // down to decode. The other hazards already discard what fetch produced.
+    else if(imem_status == IN_FLIGHT){
+        pipe_control_stage(S_FETCH, false, true);
+        pipe_control_stage(S_DECODE, true, false);
+        pipe_control_stage(S_EXECUTE, false, false);
+        pipe_control_stage(S_MEMORY, false, false);
+        pipe_control_stage(S_WBACK, false, false);
+    }
+    else {
     // No hazard detected, continue pipeline execution as normal
      pipe_control_stage(S_FETCH, false, false);
      pipe_control_stage(S_DECODE, false, false);
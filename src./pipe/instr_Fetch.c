@@ -18,6 +18,7 @@
 
 extern machine_t guest;
 extern mem_status_t dmem_status;
+extern mem_status_t imem_status;
 extern uint64_t F_PC;
 
 /*
@@ -162,6 +163,7 @@ comb_logic_t fetch_instr(f_instr_impl_t *in, d_instr_impl_t *out)
     bool imem_error = 0;
     uint64_t current_PC;
     select_PC(in->pred_PC, X_out->op, M_in->val_ex, M_out->op, M_out->cond_holds, M_out->seq_succ_PC, &current_PC);
+    imem_status = READY;
 
     /*
      * Students: This case is for generating HLT instructions
@@ -179,6 +181,18 @@ comb_logic_t fetch_instr(f_instr_impl_t *in, d_instr_impl_t *out)
     {
         uint32_t instr;
         imem(current_PC, &instr, &imem_error);
+        // I-cache miss: F stalls and D gets a bubble (see handle_hazards).
+        // Keep the PC just selected, which may be a correction that will
+        // not be offered again, and fetch it again next cycle.
+        if (imem_status == IN_FLIGHT)
+        {
+            in->pred_PC = current_PC;
+            F_PC = current_PC;
+            out->op = OP_NOP;
+            out->print_op = OP_NOP;
+            out->status = STAT_BUB;
+            return;
+        }
         // set the correct index with the right shift
         int op_index = 0x7FF & (instr >> 21);
         opcode_t opcode_val = itable[op_index];
@@ -0,0 +1,148 @@
+/**************************************************************************
+ * C S 429 system emulator
+ *
+ * bench-ptable.c - Microbenchmark for the emulator's page table.
+ *
+ * Materializes a large number of distinct pages through add_page() and
+ * times get_page() lookups on them, in sequential and in shuffled order.
+ * For comparison, the same page numbers are inserted into a copy of the
+ * original 128-bucket chained hash table, whose lookups are timed on a
+ * sample (a full pass would take minutes at a million pages).
+ *
+ * Copyright (c) 2023.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <getopt.h>
+#include <time.h>
+#include "ptable.h"
+
+#define DEFAULT_NUM_PAGES (1UL << 20)
+#define HASH_SAMPLE (1UL << 10)
+#define FIRST_PNUM (0x10000000ULL / PAGESIZE)   // Start of the heap segment
+
+/* The original chained hash table, kept here as the baseline. */
+#define HASHSIZE 128
+static pte_ptr_t legacy_ptable[HASHSIZE];
+
+static unsigned long legacy_hash(const uint64_t pnum) {
+    unsigned long h = 0, high;
+    char *s = (char *) &pnum;
+
+    for (int i = 0; i < 7; i++) {
+        h = (h << 4) + *s++;
+        if ((high = h & 0xF0000000))
+            h ^= high >> 24;
+        h &= ~high;
+    }
+    return h % HASHSIZE;
+}
+
+static pte_ptr_t legacy_get_page(const uint64_t pnum) {
+    pte_ptr_t p = legacy_ptable[legacy_hash(pnum)];
+    for (; p != NULL; p = p->p_next) {
+        if (pnum == p->p_num) return p;
+    }
+    return p;
+}
+
+static void legacy_add_page(pte_ptr_t npage) {
+    unsigned long phash = legacy_hash(npage->p_num);
+    npage->p_next = legacy_ptable[phash];
+    legacy_ptable[phash] = npage;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * usage - Prints usage info
+ */
+void usage(char *argv[]){
+    printf("Usage: %s [-h] [-n <num>]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h        Print this help message.\n");
+    printf("  -n <num>  Number of distinct pages to touch. Defaults to %lu.\n", DEFAULT_NUM_PAGES);
+}
+
+/*
+ * main - Main routine
+ */
+int main(int argc, char* argv[]){
+    size_t n = DEFAULT_NUM_PAGES;
+    char c;
+
+    while ((c = getopt(argc, argv, "hn:")) != -1) {
+        switch(c) {
+        case 'n':
+            n = strtoul(optarg, NULL, 0);
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+
+    /* Shuffled lookup order, so the tree walk cannot ride on locality. */
+    uint64_t *order = malloc(n * sizeof(uint64_t));
+    for (size_t i = 0; i < n; i++)
+        order[i] = FIRST_PNUM + i;
+    srandom(429);
+    for (size_t i = n - 1; i > 0; i--) {
+        size_t j = random() % (i + 1);
+        uint64_t tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    double t0 = now();
+    for (size_t i = 0; i < n; i++)
+        add_page(FIRST_PNUM + i, 0x6);
+    double t_add = now() - t0;
+
+    uintptr_t sink = 0;
+    t0 = now();
+    for (size_t i = 0; i < n; i++)
+        sink += (uintptr_t) get_page(FIRST_PNUM + i)->p_data;
+    double t_seq = now() - t0;
+
+    t0 = now();
+    for (size_t i = 0; i < n; i++)
+        sink += (uintptr_t) get_page(order[i])->p_data;
+    double t_rand = now() - t0;
+
+    pte_ptr_t legacy = calloc(n, sizeof(pte_t));
+    for (size_t i = 0; i < n; i++) {
+        legacy[i].p_num = FIRST_PNUM + i;
+        legacy_add_page(&legacy[i]);
+    }
+    size_t sample = n < HASH_SAMPLE ? n : HASH_SAMPLE;
+    t0 = now();
+    for (size_t i = 0; i < sample; i++)
+        sink += (uintptr_t) legacy_get_page(order[i])->p_num;
+    double t_hash = now() - t0;
+
+    printf("Pages touched: %zu\n", n);
+    printf("%-28s%12s\n", "", "ns/page");
+    printf("%-28s%12.1f\n", "radix add_page", t_add * 1e9 / n);
+    printf("%-28s%12.1f\n", "radix get_page (seq)", t_seq * 1e9 / n);
+    printf("%-28s%12.1f\n", "radix get_page (shuffled)", t_rand * 1e9 / n);
+    printf("%-28s%12.1f  (%zu sampled lookups)\n", "hash get_page (shuffled)", t_hash * 1e9 / sample, sample);
+    printf("Speedup over hash: %.1fx\n", (t_hash / sample) / (t_rand / n));
+
+    /* Keep the compiler from discarding the lookups. */
+    if (sink == 1) printf("\n");
+    free(legacy);
+    free(order);
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,158 @@
+/**************************************************************************
+ * C S 429 system emulator
+ *
+ * test-cache-alloc.c - Checks that the cache library's miss path does no
+ *     heap allocation.
+ *
+ * Linked with --wrap for malloc, calloc and realloc, so that every call
+ * from the cache library comes through a counter here. Each test builds
+ * a small cache, then runs an access pattern that misses and evicts on
+ * nearly every access, and passes if it evicted and the count did not
+ * move.
+ *
+ * Copyright (c) 2023.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include "cache.h"
+
+#define ACCESSES 100000
+#define BLOCK 32
+
+extern int miss_count;
+extern int hit_count;
+extern int dirty_eviction_count;
+extern int clean_eviction_count;
+
+static unsigned long allocs;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    allocs++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+    allocs++;
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t size) {
+    allocs++;
+    return __real_realloc(p, size);
+}
+
+// The i-th address of a walk that a 1 KB cache misses on every time.
+static uword_t address(size_t i) {
+    return (uword_t) (i % 97) * 4096 + (i % 7) * BLOCK;
+}
+
+static cache_t *setup(int A, unsigned int victim_lines) {
+    miss_count = hit_count = dirty_eviction_count = clean_eviction_count = 0;
+    cache_t *cache = create_cache(A, BLOCK, 1024, 0);
+    if (victim_lines)
+        cache_add_victim(cache, victim_lines);
+    return cache;
+}
+
+static void run_access_data(cache_t *cache) {
+    for (size_t i = 0; i < ACCESSES; i++)
+        access_data(cache, address(i), i % 3 ? READ : WRITE);
+}
+
+// The way se's memory stage uses the library, with its own fill data.
+static void run_handle_miss(cache_t *cache) {
+    static byte_t fill[BLOCK], evicted_data[BLOCK];
+    for (size_t i = 0; i < ACCESSES; i++) {
+        operation_t op = i % 3 ? READ : WRITE;
+        if (check_hit(cache, address(i), op))
+            continue;
+        evicted_line_t evicted = {.data = evicted_data};
+        handle_miss(cache, address(i), op, fill, &evicted);
+    }
+}
+
+static void run_access_batch(cache_t *cache) {
+    static uword_t addrs[ACCESSES];
+    static operation_t ops[ACCESSES];
+    for (size_t i = 0; i < ACCESSES; i++) {
+        addrs[i] = address(i);
+        ops[i] = i % 3 ? READ : WRITE;
+    }
+    cache_stats_t stats = {0};
+    access_batch(cache, addrs, ops, ACCESSES, &stats);
+    miss_count = stats.misses;
+    dirty_eviction_count = stats.dirty_evictions;
+    clean_eviction_count = stats.clean_evictions;
+}
+
+typedef struct alloc_test {
+    const char *name;
+    int A;
+    unsigned int victim_lines;
+    void (*run)(cache_t *);
+} alloc_test_t;
+
+/*
+ * usage - Prints usage info
+ */
+void usage(char *argv[]){
+    printf("Usage: %s [-h]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h    Print this help message.\n");
+}
+
+/*
+ * main - Main routine
+ */
+int main(int argc, char* argv[]){
+    char c;
+
+    while ((c = getopt(argc, argv, "h")) != -1) {
+        switch(c) {
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+
+    alloc_test_t tests[] = {
+        {"access_data, direct-mapped", 1, 0, run_access_data},
+        {"access_data, 4-way", 4, 0, run_access_data},
+        {"access_data, victim cache", 1, 8, run_access_data},
+        {"handle_miss, direct-mapped", 1, 0, run_handle_miss},
+        {"handle_miss, victim cache", 2, 4, run_handle_miss},
+        {"access_batch, 4-way", 4, 0, run_access_batch},
+        {"access_batch, victim cache", 1, 8, run_access_batch},
+    };
+    int num_tests = sizeof(tests) / sizeof(tests[0]);
+    int passed = 0;
+
+    printf("%-30s%10s%12s%10s\n", "Test", "Misses", "Evictions", "Allocs");
+    for (int i = 0; i < num_tests; i++) {
+        cache_t *cache = setup(tests[i].A, tests[i].victim_lines);
+        unsigned long before = allocs;
+        tests[i].run(cache);
+        unsigned long during = allocs - before;
+        int evictions = dirty_eviction_count + clean_eviction_count;
+        bool ok = during == 0 && miss_count > ACCESSES / 2 && evictions > 0;
+        printf("%-30s%10d%12d%10lu  %s\n", tests[i].name, miss_count, evictions, during,
+               ok ? "ok" : "FAIL");
+        passed += ok;
+        free_cache(cache);
+    }
+
+    printf("\nTEST_CACHE_ALLOC_RESULTS=%d/%d\n", passed, num_tests);
+    exit(passed == num_tests ? EXIT_SUCCESS : EXIT_FAILURE);
+}
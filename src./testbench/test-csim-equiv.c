@@ -0,0 +1,275 @@
+/**************************************************************************
+ * C S 429 system emulator
+ *
+ * test-csim-equiv.c - Checks csim's shortcuts against plain csim runs.
+ *
+ * The replacement policies of -P are checked against known results, which
+ * came from a separate model of each policy, since csim-ref has only LRU.
+ *
+ * csim -S gives the misses of a fully associative LRU cache of every
+ * capacity in one pass. Each row it prints is checked against a csim run
+ * of that size, and the size one line smaller against the row before.
+ *
+ * Each trace is also converted to the binary format, with and without
+ * compression, and csim -T binary must give the same results on it as on
+ * the text, as must the text that trace-convert -d decodes it back to. A
+ * binary trace cut short must be rejected. These need bin/trace-convert,
+ * from make tools.
+ *
+ * Copyright (c) 2023.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/
+
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define MAX_STR 1024  /* Max string size */
+
+#define TRACE "testcases/cache/long.trace"
+#define CURVE ".csim_curve"
+#define BINARY ".csim_trace.bin"
+#define DECODED ".csim_trace.txt"
+#define CUT ".csim_trace.cut"
+
+int verbosity;
+
+/*
+ * usage - Prints usage info
+ */
+void usage(char *argv[]){
+    printf("Usage: %s [-hv]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h        Print this help message.\n");
+    printf("  -v <num>  Verbosity level. Defaults to 0, which only shows the results.\n            Set to 1 to view which tests are failing.\n            Set to 2 to view all tests as they run.\n");
+}
+
+/*
+ * SIGALRM handler
+ */
+void sigalrm_handler(int signum)
+{
+    printf("Error: Program timed out.\n");
+    exit(EXIT_FAILURE);
+}
+
+/*
+ * run - Runs a command, quietly. Return its exit status, or -1 if it could
+ * not be run.
+ */
+static int run(char *cmd) {
+    char buf[MAX_STR];
+    int status;
+
+    if (verbosity > 1)
+        fprintf(stderr, "  %s\n", cmd);
+    sprintf(buf, "(%s) > /dev/null 2> /dev/null", cmd);
+    status = system(buf);
+    if (status == -1) {
+        fprintf(stderr, "Error invoking system(): %s\n", strerror(errno));
+        return -1;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+/*
+ * csim - Runs csim with the given arguments and collects its results.
+ * Return 0 if any problems, 1 if OK.
+ */
+static int csim(char *args, int results[4]) {
+    char cmd[MAX_STR];
+    FILE *fp;
+
+    system("rm -f .csim_results");
+    sprintf(cmd, "./bin/csim %s", args);
+    if (run(cmd) != 0)
+        return 0;
+    fp = fopen(".csim_results", "r");
+    if (!fp)
+        return 0;
+    int n = fscanf(fp, "%d %d %d %d", &results[0], &results[1], &results[2], &results[3]);
+    fclose(fp);
+    return n == 4;
+}
+
+static int passed, total;
+
+static void check(int pass, char *what) {
+    if (!pass && verbosity > 0)
+        fprintf(stderr, "Failed test %s\n", what);
+    passed += pass;
+    total++;
+}
+
+/*
+ * test_stack_distance - Checks each row of csim -S, and the capacity just
+ * below it, against csim -A C/B on the same trace.
+ */
+static void test_stack_distance(void) {
+    char args[MAX_STR];
+    int results[4];
+    int B, lines, misses, prev_B = 0, prev_misses = 0;
+
+    if (run("./bin/csim -S -B 8,32,64 -t " TRACE " > " CURVE) != 0) {
+        check(0, "csim -S");
+        return;
+    }
+    FILE *fp = fopen(CURVE, "r");
+    if (!fp || fscanf(fp, "%*[^\n]\n") != 0) {
+        check(0, "csim -S output");
+        return;
+    }
+    while (fscanf(fp, "%d,%d,%*d,%d,%*f\n", &B, &lines, &misses) == 3) {
+        sprintf(args, "-A %d -B %d -C %d -t %s", lines, B, lines * B, TRACE);
+        check(csim(args, results) && results[1] == misses, args);
+        if (B == prev_B && lines > 1) {
+            sprintf(args, "-A %d -B %d -C %d -t %s", lines - 1, B, (lines - 1) * B, TRACE);
+            check(csim(args, results) && results[1] == prev_misses, args);
+        }
+        prev_B = B;
+        prev_misses = misses;
+    }
+    fclose(fp);
+    system("rm -f " CURVE);
+}
+
+typedef struct policy_test {
+    char *args;
+    int results[4];     /* hits, misses, dirty and clean evictions */
+} policy_test_t;
+
+static policy_test_t policy_tests[] = {
+    {"-P plru -A 2 -B 8 -C 128 -t testcases/cache/trans.trace", {209, 29, 7, 6}},
+    {"-P bitplru -A 2 -B 8 -C 128 -t testcases/cache/trans.trace", {209, 29, 7, 6}},
+    {"-P srrip -A 2 -B 8 -C 128 -t testcases/cache/trans.trace", {206, 32, 11, 5}},
+    {"-P brrip -A 2 -B 8 -C 128 -t testcases/cache/trans.trace", {203, 35, 14, 5}},
+    {"-P fifo -A 2 -B 8 -C 128 -t testcases/cache/trans.trace", {204, 34, 13, 5}},
+    {"-P random -A 2 -B 8 -C 128 -t testcases/cache/trans.trace", {205, 33, 10, 7}},
+    {"-P plru -A 4 -B 16 -C 256 -t " TRACE, {266478, 20486, 16378, 4092}},
+    {"-P bitplru -A 4 -B 16 -C 256 -t " TRACE, {266474, 20490, 16385, 4089}},
+    {"-P srrip -A 4 -B 16 -C 256 -t " TRACE, {266474, 20490, 16385, 4089}},
+    {"-P brrip -A 4 -B 16 -C 256 -t " TRACE, {264019, 22945, 15971, 6958}},
+    {"-P fifo -A 4 -B 16 -C 256 -t " TRACE, {261675, 25289, 17730, 7543}},
+    {"-P random -A 4 -B 16 -C 256 -t " TRACE, {262589, 24375, 16715, 7644}},
+    {"-P plru -A 8 -B 32 -C 1024 -t " TRACE, {273134, 13830, 11768, 2030}},
+    {"-P bitplru -A 8 -B 32 -C 1024 -t " TRACE, {274893, 12071, 10011, 2028}},
+    {"-P srrip -A 8 -B 32 -C 1024 -t " TRACE, {272504, 14460, 12401, 2027}},
+    {"-P brrip -A 8 -B 32 -C 1024 -t " TRACE, {266556, 20408, 15695, 4681}},
+    {"-P fifo -A 8 -B 32 -C 1024 -t " TRACE, {271693, 15271, 12363, 2876}},
+    {"-P random -A 8 -B 32 -C 1024 -t " TRACE, {274068, 12896, 10073, 2791}},
+};
+
+/*
+ * test_policies - Checks each replacement policy against its known results.
+ */
+static void test_policies(void) {
+    int results[4];
+
+    for (int i = 0; i < sizeof(policy_tests) / sizeof(policy_tests[0]); i++) {
+        check(csim(policy_tests[i].args, results)
+              && !memcmp(results, policy_tests[i].results, sizeof(results)), policy_tests[i].args);
+    }
+}
+
+/*
+ * same_results - Runs csim on two traces with the same cache. Return 1 if
+ * both runs work and give the same results.
+ */
+static int same_results(char *config, char *trace_args, char *other_args) {
+    char args[MAX_STR];
+    int expected[4], actual[4];
+
+    sprintf(args, "%s %s", config, trace_args);
+    if (!csim(args, expected))
+        return 0;
+    sprintf(args, "%s %s", config, other_args);
+    return csim(args, actual) && !memcmp(expected, actual, sizeof(expected));
+}
+
+/*
+ * test_binary_traces - Converts each trace to binary and back, and checks
+ * that csim cannot tell the difference.
+ */
+static void test_binary_traces(void) {
+    char *traces[] = {"yi2.trace", "yi.trace", "dave.trace", "trans.trace", "long.trace"};
+    char *configs[] = {"-A 1 -B 8 -C 32", "-A 2 -B 16 -C 512", "-A 4 -B 32 -C 1024"};
+    char *flags[] = {"", "-z"};
+    char cmd[MAX_STR], what[MAX_STR], text[MAX_STR];
+    struct stat st;
+
+    for (int i = 0; i < sizeof(traces) / sizeof(traces[0]); i++) {
+        sprintf(text, "-t testcases/cache/%s", traces[i]);
+        for (int z = 0; z < 2; z++) {
+            sprintf(cmd, "./bin/trace-convert %s -i testcases/cache/%s -o " BINARY, flags[z], traces[i]);
+            sprintf(what, "trace-convert %s on %s", flags[z], traces[i]);
+            if (run(cmd) != 0 || stat(BINARY, &st) != 0) {
+                check(0, what);
+                continue;
+            }
+            for (int j = 0; j < sizeof(configs) / sizeof(configs[0]); j++) {
+                sprintf(what, "csim %s -T binary on %s %s", configs[j], traces[i], flags[z]);
+                check(same_results(configs[j], text, "-T binary -t " BINARY), what);
+            }
+            sprintf(what, "trace-convert -d on %s %s", traces[i], flags[z]);
+            check(run("./bin/trace-convert -d -i " BINARY " -o " DECODED) == 0
+                  && same_results(configs[1], text, "-t " DECODED), what);
+
+            // Cut off in the file header, in the first block's header, and
+            // short of the end of the last block.
+            off_t cuts[] = {4, 20, st.st_size - 1};
+            for (int k = 0; k < sizeof(cuts) / sizeof(cuts[0]); k++) {
+                sprintf(cmd, "head -c %ld " BINARY " > " CUT " && ./bin/csim %s -T binary -t " CUT,
+                        (long) cuts[k], configs[0]);
+                sprintf(what, "%s %s cut to %ld bytes", traces[i], flags[z], (long) cuts[k]);
+                check(run(cmd) > 0, what);
+            }
+        }
+    }
+    system("rm -f " BINARY " " DECODED " " CUT);
+}
+
+/*
+ * main - Main routine
+ */
+int main(int argc, char* argv[]){
+    char c;
+    verbosity = 0;
+
+    while ((c = getopt(argc, argv, "hv:")) != -1) {
+        switch(c) {
+        case 'h':
+            usage(argv);
+            exit(EXIT_SUCCESS);
+        case 'v':
+            verbosity = atoi(optarg);
+            break;
+        default:
+            usage(argv);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /* Install timeout handler */
+    if (signal(SIGALRM, sigalrm_handler) == SIG_ERR) {
+        fprintf(stderr, "Unable to install SIGALRM handler\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Time out and give up after a while */
+    alarm(120);
+
+    test_stack_distance();
+    test_policies();
+    test_binary_traces();
+    system("rm -f .csim_results");
+
+    printf("TEST_CSIM_EQUIV_RESULTS=%d/%d\n", passed, total);
+    exit(passed == total ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,219 @@
+/**************************************************************************
+ * C S 429 system emulator
+ *
+ * test-se-equiv.c - Checks that se's optional machinery leaves the results
+ *     of a program alone.
+ *
+ * Each test runs se on a testcase in two ways that must end in the same
+ * registers and memory, and diffs their final checkpoints, leaving out the
+ * cycle and cache hit counts. The expected run is a plain one, without a
+ * cache, unless the test gives its own. Runs with a cache use -f, so that
+ * what the caches hold shows in memory.
+ *
+ * Runs are shell commands, with the testcase in $T and the checkpoint to
+ * write in $O. $S names a scratch file, and $N is half the cycles the plain
+ * run takes, for stopping a run partway. The ckpt-merge tests need
+ * bin/ckpt-merge, from make tools.
+ *
+ * Copyright (c) 2023.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/
+
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define MAX_STR 1024  /* Max string size */
+
+#define SE "./bin/se -l 100000000 -i $T"
+#define CACHE SE " -A 2 -B 8 -C 64 -d 5 -f"
+#define L2 " -L 4:8:256:10"
+#define SLOW SE " -A 2 -B 8 -C 64 -d 50 -f" L2
+#define STOPPED SE " -A 2 -B 8 -C 64 -d 50 -f -L 4:8:256:2 -F inclusive -b 16 -M 4"
+
+#define CKPT_PLAIN "checkpoint/equiv_plain.out"
+#define CKPT_BASE "checkpoint/equiv_base.out"
+#define CKPT_RUN "checkpoint/equiv_run.out"
+#define SCRATCH "checkpoint/equiv_scratch"
+
+typedef struct equiv_test {
+    char *name;
+    char *base;     /* NULL for the plain run */
+    char *run;
+    char *ignore;   /* Another line to leave out of the diff, or NULL */
+} equiv_test_t;
+
+static equiv_test_t tests[] = {
+    {"write back, one level", NULL, CACHE " -c $O"},
+    {"write back, nine", NULL, CACHE L2 " -F nine -c $O"},
+    {"write back, inclusive", NULL, CACHE L2 " -F inclusive -c $O"},
+    {"write back, exclusive", NULL, CACHE L2 " -F exclusive -c $O"},
+    {"write back, victim cache", NULL, CACHE L2 " -V 4 -c $O"},
+    {"prefetch, next", NULL, CACHE L2 " -p next -c $O"},
+    {"prefetch, stride", NULL, CACHE L2 " -p stride -c $O"},
+    {"prefetch, stream", NULL, CACHE L2 " -p stream -c $O"},
+    {"write-through", NULL, CACHE L2 " -W through -c $O"},
+    {"no write-allocate", NULL, CACHE L2 " -N -c $O"},
+    {"write buffer of 1", NULL, CACHE L2 " -W through -N -b 1 -c $O"},
+    // Fetch waits on I-cache misses while the rest of the pipeline drains,
+    // so the run halts with fetch at a different PC past the last
+    // instruction.
+    {"I-cache", NULL, CACHE L2 " -I 2:8:64 -c $O", "Program Counter"},
+    {"ckpt-merge", SE " -K $((N / 8)) -c $O",
+     SE " -K $((N / 8)) -D -c $S && ./bin/ckpt-merge -i $S -o $O"},
+    {"ckpt-merge, with a cache", CACHE " -K $((N / 8)) -c $O",
+     CACHE " -K $((N / 8)) -D -c $S && ./bin/ckpt-merge -i $S -o $O"},
+    {"snapshot", NULL, SE " -l $N -S $S && " SE " -R $S -c $O"},
+    {"snapshot, with a cache", CACHE L2 " -c $O",
+     CACHE L2 " -l $N -S $S && " CACHE L2 " -R $S -c $O"},
+    {"MSHRs", SLOW " -c $O", SLOW " -M 4 -c $O"},
+    {"MSHRs, snapshot", SLOW " -c $O", SLOW " -M 4 -l $N -S $S && " SLOW " -M 4 -R $S -c $O"},
+    // A run stopped by -l has misses outstanding, and stores waiting on
+    // them. Write-through has put those in memory already. With an
+    // inclusive L2 and a write buffer that never fills, it takes the same
+    // cycles as write-back, so both runs stop at the same instruction.
+    {"MSHRs, stopped", STOPPED " -W through -l $N -c $O", STOPPED " -l $N -c $O"},
+};
+
+static char *testcases[] = {
+    "testcases/mem/simple/ldur_stur", "testcases/mem/hazard/stur",
+    "testcases/applications/hard/iter_sum", "testcases/applications/hard/rec_sum",
+    "testcases/applications/hard/gemm_block",
+};
+
+int verbosity;
+
+/*
+ * usage - Prints usage info
+ */
+void usage(char *argv[]){
+    printf("Usage: %s [-hv]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h        Print this help message.\n");
+    printf("  -v <num>  Verbosity level. Defaults to 0, which only shows the results.\n            Set to 1 to view which tests are failing.\n            Set to 2 to view all tests as they run.\n");
+}
+
+/*
+ * SIGALRM handler
+ */
+void sigalrm_handler(int signum)
+{
+    printf("Error: Program timed out.\n");
+    exit(EXIT_FAILURE);
+}
+
+/*
+ * run - Runs one side of a test. Return 0 if any problems, 1 if OK.
+ */
+static int run(char *recipe, char *testcase, char *out, unsigned long half) {
+    char cmd[MAX_STR];
+    int status;
+
+    sprintf(cmd, "T=%s O=%s S=%s N=%lu; (%s) > /dev/null 2> /dev/null",
+            testcase, out, SCRATCH, half, recipe);
+    if (verbosity > 1)
+        fprintf(stderr, "  %s\n", recipe);
+    status = system(cmd);
+    if (status == -1) {
+        fprintf(stderr, "Error invoking system(): %s\n", strerror(errno));
+        return 0;
+    }
+    if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+        if (verbosity > 0)
+            fprintf(stderr, "Error running %s: Status %d\n", recipe, WEXITSTATUS(status));
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * same_state - Diffs two checkpoints, leaving out the cycle and cache hit
+ * counts, and any lines matching ignore. Return 1 if they match.
+ */
+static int same_state(char *expected, char *actual, char *ignore) {
+    char cmd[MAX_STR];
+    char *skip = ignore ? ignore : "checkpoint after";
+
+    sprintf(cmd, "diff -I 'checkpoint after' -I 'hits, misses' -I '%s' %s %s > /dev/null",
+            skip, expected, actual);
+    if (system(cmd) == 0)
+        return 1;
+    if (verbosity > 0) {
+        sprintf(cmd, "diff -I 'checkpoint after' -I 'hits, misses' -I '%s' %s %s | head -20 >&2",
+                skip, expected, actual);
+        system(cmd);
+    }
+    return 0;
+}
+
+/*
+ * main - Main routine
+ */
+int main(int argc, char* argv[]){
+    char c;
+    verbosity = 0;
+
+    while ((c = getopt(argc, argv, "hv:")) != -1) {
+        switch(c) {
+        case 'h':
+            usage(argv);
+            exit(EXIT_SUCCESS);
+        case 'v':
+            verbosity = atoi(optarg);
+            break;
+        default:
+            usage(argv);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /* Install timeout handler */
+    if (signal(SIGALRM, sigalrm_handler) == SIG_ERR) {
+        fprintf(stderr, "Unable to install SIGALRM handler\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Time out and give up after a while in case of infinite loops */
+    alarm(600);
+
+    int num_tests = sizeof(tests) / sizeof(tests[0]);
+    int num_testcases = sizeof(testcases) / sizeof(testcases[0]);
+    int passed = 0, total = 0;
+
+    for (int i = 0; i < num_testcases; i++) {
+        unsigned long cycles = 0;
+        if (!run(SE " -c $O", testcases[i], CKPT_PLAIN, 0)) {
+            fprintf(stderr, "Error: plain run of %s failed\n", testcases[i]);
+            exit(EXIT_FAILURE);
+        }
+        FILE *fp = fopen(CKPT_PLAIN, "r");
+        if (!fp || fscanf(fp, "Machine state checkpoint after %lu cycles", &cycles) != 1) {
+            fprintf(stderr, "Error: no checkpoint from the plain run of %s\n", testcases[i]);
+            exit(EXIT_FAILURE);
+        }
+        fclose(fp);
+
+        for (int j = 0; j < num_tests; j++) {
+            if (verbosity > 1)
+                fprintf(stderr, "Running %s on %s\n", tests[j].name, testcases[i]);
+            char *expected = tests[j].base ? CKPT_BASE : CKPT_PLAIN;
+            int pass = (!tests[j].base || run(tests[j].base, testcases[i], CKPT_BASE, cycles / 2))
+                       && run(tests[j].run, testcases[i], CKPT_RUN, cycles / 2)
+                       && same_state(expected, CKPT_RUN, tests[j].ignore);
+            if (!pass && verbosity > 0)
+                fprintf(stderr, "Failed test %s on %s\n", tests[j].name, testcases[i]);
+            passed += pass;
+            total++;
+        }
+    }
+    system("rm -f " CKPT_PLAIN " " CKPT_BASE " " CKPT_RUN " " SCRATCH "*");
+
+    printf("TEST_SE_EQUIV_RESULTS=%d/%d\n", passed, total);
+    exit(passed == total ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,122 @@
+/**************************************************************************
+ * C S 429 system emulator
+ *
+ * ckpt-merge.c - Rebuild full checkpoints from incremental ones.
+ *
+ * Reads a checkpoint file written by se -D, where each checkpoint lists
+ * only the pages created or written since the previous one, and writes
+ * the full checkpoints se would have written without -D. Everything but
+ * the memory part of each checkpoint is copied through unchanged, as are
+ * full checkpoints.
+ *
+ * Copyright (c) 2023.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+#include "mem.h"
+#include "ptable.h"
+#include "checkpoint.h"
+
+#define LINE_LEN 1024
+
+static char *peek_page(const uint64_t pnum) {
+    pte_ptr_t page = get_page(pnum);
+    return page ? page->p_data : NULL;
+}
+
+/*
+ * usage - Prints usage info
+ */
+void usage(char *argv[]){
+    printf("Usage: %s [-h] [-i <file>] [-o <file>]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h         Print this help message.\n");
+    printf("  -i <file>  Incremental checkpoint file to read. Defaults to stdin.\n");
+    printf("  -o <file>  File to write full checkpoints to. Defaults to stdout.\n");
+}
+
+/*
+ * main - Main routine
+ */
+int main(int argc, char* argv[]){
+    FILE *in = stdin, *out = stdout;
+    char c;
+
+    while ((c = getopt(argc, argv, "hi:o:")) != -1) {
+        switch(c) {
+        case 'i':
+            if ((in = fopen(optarg, "r")) == NULL) {
+                perror(optarg);
+                exit(1);
+            }
+            break;
+        case 'o':
+            if ((out = fopen(optarg, "w")) == NULL) {
+                perror(optarg);
+                exit(1);
+            }
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+
+    char line[LINE_LEN];
+    uint64_t seg_start[KERNEL_SEG+1] = {0};
+    bool in_delta = false;
+    char *page = NULL;
+    unsigned long lineno = 0;
+
+    while (fgets(line, LINE_LEN, in)) {
+        lineno++;
+        if (!in_delta) {
+            if (!strcmp(line, CKPT_DELTA_HEADER))
+                in_delta = true;
+            else
+                fputs(line, out);
+            continue;
+        }
+        uint64_t addr, word;
+        if (!strncmp(line, "\t\tSegment starts:", 17)) {
+            char *s = line + 17;
+            for (int i = 0; i <= KERNEL_SEG; i++)
+                seg_start[i] = strtoull(s, &s, 0);
+        }
+        else if (sscanf(line, "\t\tPage 0x%lx:", &addr) == 1) {
+            pte_ptr_t p = get_page(addr);
+            if (NULL == p)
+                p = add_page(addr, 0);
+            // The page is listed in full, so words that are not listed are zero.
+            memset(p->p_data, 0, PAGESIZE);
+            page = p->p_data;
+        }
+        else if (sscanf(line, "\t\t\tAddress 0x%lx: 0x%lx", &addr, &word) == 2) {
+            if (NULL == page) {
+                fprintf(stderr, "line %lu: address outside of a page\n", lineno);
+                exit(1);
+            }
+            *(uint64_t *)(page + addr % PAGESIZE) = word;
+        }
+        else {
+            // End of the page list: print the memory state as se would have.
+            log_mem_state(out, seg_start, peek_page);
+            fputs(line, out);
+            in_delta = false;
+            page = NULL;
+        }
+    }
+    if (in_delta)
+        log_mem_state(out, seg_start, peek_page);
+    free_ptable();
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,106 @@
+/**************************************************************************
+ * C S 429 system emulator
+ *
+ * trace-convert.c - Convert Valgrind memory traces to and from the binary
+ *     format csim -T binary reads.
+ *
+ * Only the data accesses survive conversion, which is all that csim uses;
+ * decoding a binary trace gives back " L addr,len" style lines for them.
+ *
+ * Copyright (c) 2023.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include "trace.h"
+
+/*
+ * usage - Prints usage info
+ */
+void usage(char *argv[]){
+    printf("Usage: %s [-hz] -i <file> -o <file>\n", argv[0]);
+    printf("       %s -d -i <file> [-o <file>]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h         Print this help message.\n");
+    printf("  -z         Compress each block of the binary trace.\n");
+    printf("  -d         Decode a binary trace back to text.\n");
+    printf("  -i <file>  Trace file to read.\n");
+    printf("  -o <file>  File to write. Decoding defaults to stdout.\n");
+}
+
+/*
+ * main - Main routine
+ */
+int main(int argc, char* argv[]){
+    char *in_fn = NULL, *out_fn = NULL;
+    bool compress = false, decode = false;
+    char c;
+
+    while ((c = getopt(argc, argv, "hzdi:o:")) != -1) {
+        switch(c) {
+        case 'z':
+            compress = true;
+            break;
+        case 'd':
+            decode = true;
+            break;
+        case 'i':
+            in_fn = optarg;
+            break;
+        case 'o':
+            out_fn = optarg;
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+    if (!in_fn || (!decode && !out_fn)) {
+        usage(argv);
+        exit(1);
+    }
+
+    static trace_rec_t recs[TRACE_BATCH];
+    size_t n;
+    trace_format = decode ? TRACE_BINARY : TRACE_TEXT;
+    trace_t *trace = trace_open(in_fn);
+
+    if (decode) {
+        FILE *out = stdout;
+        if (out_fn && (out = fopen(out_fn, "w")) == NULL) {
+            perror(out_fn);
+            exit(1);
+        }
+        while ((n = trace_read(trace, recs, TRACE_BATCH)) > 0)
+            for (size_t i = 0; i < n; i++)
+                fprintf(out, " %c %llx,%u\n", recs[i].op, recs[i].addr, recs[i].len);
+        trace_close(trace);
+        if (out != stdout)
+            fclose(out);
+        return 0;
+    }
+
+    trace_writer_t *w = trace_writer_open(out_fn, compress);
+    uint64_t records = 0;
+    while ((n = trace_read(trace, recs, TRACE_BATCH)) > 0) {
+        trace_write(w, recs, n);
+        records += n;
+    }
+    trace_close(trace);
+    trace_writer_close(w);
+
+    struct stat in_st, out_st;
+    if (stat(in_fn, &in_st) == 0 && stat(out_fn, &out_st) == 0 && out_st.st_size > 0)
+        printf("%lu records: %ld bytes of text, %ld bytes binary, ratio %.2f\n", records,
+               (long) in_st.st_size, (long) out_st.st_size, (double) in_st.st_size / out_st.st_size);
+    return 0;
+}